@@ -0,0 +1,60 @@
+import sys
+import json
+
+from latency_report import collect
+
+BENCH_PREFIX = "BENCH "
+
+
+def read_benchmarks(lines):
+    """Returns the latest benchmark report of every node found in the serial log of player nodes."""
+    nodes = {}
+    for line in lines:
+        line = line.strip()
+        if not line.startswith(BENCH_PREFIX):
+            continue
+        try:
+            report = json.loads(line[len(BENCH_PREFIX):])
+        except ValueError:
+            continue
+        nodes[report["Node"]] = report
+    return nodes
+
+
+def percentile(values, fraction):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(fraction * len(values)))] if values else 0
+
+
+def print_profiles(nodes, players):
+    """Prints radio-on time, latency and delivery ratio per duty cycling profile."""
+    profiles = {}
+    for node, report in nodes.items():
+        profiles.setdefault(report["Profile"], []).append(node)
+
+    print("%-15s %5s %9s %9s %12s %12s" % ("Profile", "Nodes", "Radio on", "Delivered", "Median (ms)", "95th (ms)"))
+    for profile in sorted(profiles):
+        members = profiles[profile]
+        radio_on = sum(nodes[node]["RadioOn"] for node in members) / len(members) / 10.0
+        received = sum(players[node].received for node in members if node in players)
+        lost = sum(players[node].lost for node in members if node in players)
+        ages = [age for node in members if node in players for age in players[node].ages]
+        delivered = 100.0 * received / (received + lost) if received + lost else 0.0
+        print("%-15s %5d %8.2f%% %8.1f%% %12d %12d" % (
+            profile, len(members), radio_on, delivered, percentile(ages, 0.5), percentile(ages, 0.95)))
+
+
+# Compares the duty cycling profiles of a benchmark run, e.g.
+# python benchmark_report.py gateway.log node1.log node2.log
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        print("Usage: %s GATEWAY_LOG NODE_LOG..." % sys.argv[0])
+        sys.exit(1)
+
+    with open(sys.argv[1]) as gateway_log:
+        players = collect(gateway_log)
+    nodes = {}
+    for path in sys.argv[2:]:
+        with open(path) as node_log:
+            nodes.update(read_benchmarks(node_log))
+    print_profiles(nodes, players)
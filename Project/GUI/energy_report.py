@@ -0,0 +1,99 @@
+import sys
+import json
+
+# Current draw of the CC2538 in mA per Energest component and the supply voltage, from the datasheet
+COMPONENT_CURRENT_MA = {
+    "CPU": 7.0,
+    "LPM": 0.0013,
+    "Transmit": 34.0,
+    "Listen": 24.0,
+}
+SUPPLY_VOLTAGE = 3.3
+COMPONENTS = list(COMPONENT_CURRENT_MA)
+
+# The firmware sends the times in ms as 24 bit values
+TIME_MODULO = 1 << 24
+# Devices send a summary every 30 s, a longer step between two of them is a reboot and not a wrap-around
+MAX_SUMMARY_GAP_MS = 60 * 60 * 1000
+
+
+class NodeEnergy:
+    """Energy summaries of one device, the times are accumulated across the 24 bit wrap-around and reboots."""
+
+    def __init__(self):
+        self.last = None
+        self.times = dict.fromkeys(COMPONENTS, 0)
+
+    def add(self, summary):
+        if self.last is not None:
+            steps = {c: (summary[c] - self.last[c]) % TIME_MODULO for c in COMPONENTS}
+            decreased = any(summary[c] < self.last[c] for c in COMPONENTS)
+            # CPU and LPM time add up to the time between the summaries, unless the device started over
+            if decreased and steps["CPU"] + steps["LPM"] > MAX_SUMMARY_GAP_MS:
+                # The counters restarted at 0, so the new totals are the time since the reboot
+                steps = {c: summary[c] for c in COMPONENTS}
+            for component in COMPONENTS:
+                self.times[component] += steps[component]
+        self.last = summary
+
+    def energy_mj(self, component):
+        return self.times[component] / 1000.0 * COMPONENT_CURRENT_MA[component] * SUPPLY_VOLTAGE
+
+    def duration_s(self):
+        return (self.times["CPU"] + self.times["LPM"]) / 1000.0
+
+
+def collect(lines):
+    """Collects the energy summaries printed by a gateway, per device id."""
+    nodes = {}
+    for line in lines:
+        line = line.strip()
+        if not line.startswith("{"):
+            continue
+        try:
+            summary = json.loads(line)
+        except ValueError:
+            continue
+        if "Energy" not in summary:
+            continue
+        nodes.setdefault(summary["Energy"], NodeEnergy()).add(summary)
+    return nodes
+
+
+def print_report(nodes):
+    print("%-6s %8s" % ("Node", "Time (s)") + "".join(" %13s" % ("%s (mJ)" % c) for c in COMPONENTS) +
+          " %10s" % "Avg (mW)")
+    for node in sorted(nodes):
+        energy = nodes[node]
+        total = sum(energy.energy_mj(c) for c in COMPONENTS)
+        duration = energy.duration_s()
+        print("%-6d %8.0f" % (node, duration) + "".join(" %13.1f" % energy.energy_mj(c) for c in COMPONENTS) +
+              " %10.2f" % (total / duration if duration else 0.0))
+
+
+def plot_report(nodes):
+    import matplotlib.pyplot as plt
+
+    labels = [str(node) for node in sorted(nodes)]
+    bottom = [0.0] * len(labels)
+    for component in COMPONENTS:
+        # Average power per component, so nodes with different uptimes compare
+        values = [nodes[node].energy_mj(component) / nodes[node].duration_s() if nodes[node].duration_s() else 0.0
+                  for node in sorted(nodes)]
+        plt.bar(labels, values, bottom=bottom, label=component)
+        bottom = [b + v for b, v in zip(bottom, values)]
+    plt.xlabel("Node")
+    plt.ylabel("Average power (mW)")
+    plt.title("Energy per component")
+    plt.legend()
+    plt.show()
+
+
+# Charts the energy summaries found in a gateway log, e.g. python energy_report.py gateway.log [--no-chart]
+if __name__ == "__main__":
+    paths = [arg for arg in sys.argv[1:] if not arg.startswith("--")]
+    source = open(paths[0]) if paths else sys.stdin
+    nodes = collect(source)
+    print_report(nodes)
+    if nodes and "--no-chart" not in sys.argv:
+        plot_report(nodes)
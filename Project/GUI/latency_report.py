@@ -0,0 +1,77 @@
+import sys
+import json
+
+# Upper bounds of the latency histogram buckets in ms, the last bucket takes everything older
+LATENCY_BUCKETS = [50, 100, 200, 500, 1000, 2000, 5000]
+SEQNO_MODULO = 256
+
+
+class PlayerStats:
+    """Delivery statistics of one player node, identified by the device id of the origin."""
+
+    def __init__(self):
+        self.last_seqno = None
+        self.received = 0
+        self.lost = 0
+        self.histogram = [0] * (len(LATENCY_BUCKETS) + 1)
+        self.ages = []
+
+    def add(self, seqno, age):
+        if self.last_seqno is not None:
+            gap = (seqno - self.last_seqno) % SEQNO_MODULO
+            # A gap of 0 or a step backwards is a late duplicate, not a lost reading
+            if gap == 0 or gap > SEQNO_MODULO // 2:
+                return
+            self.lost += gap - 1
+        self.last_seqno = seqno
+        self.received += 1
+        self.ages.append(age)
+
+        for i, bound in enumerate(LATENCY_BUCKETS):
+            if age < bound:
+                self.histogram[i] += 1
+                break
+        else:
+            self.histogram[-1] += 1
+
+    def loss_rate(self):
+        expected = self.received + self.lost
+        return self.lost / expected if expected else 0.0
+
+
+def collect(lines):
+    """Collects the statistics of every player from the JSON lines printed by a gateway."""
+    players = {}
+    for line in lines:
+        line = line.strip()
+        if not line.startswith("{"):
+            continue
+        try:
+            message = json.loads(line)
+        except ValueError:
+            continue
+        if "Origin" not in message or "Seq" not in message or "Age" not in message:
+            continue
+        # Further samples of a batch share the sequence number of the first one
+        if message.get("Sample", 0) > 0:
+            continue
+        origin = message["Origin"]
+        players.setdefault(origin, PlayerStats()).add(message["Seq"], message["Age"])
+    return players
+
+
+def print_report(players):
+    labels = ["< %d ms" % bound for bound in LATENCY_BUCKETS] + [">= %d ms" % LATENCY_BUCKETS[-1]]
+    for origin in sorted(players):
+        stats = players[origin]
+        print("Player %d: %d received, %d lost, loss rate %.1f %%" % (
+            origin, stats.received, stats.lost, 100 * stats.loss_rate()))
+        for label, count in zip(labels, stats.histogram):
+            bar = "#" * (50 * count // stats.received) if stats.received else ""
+            print("  %-10s %6d %s" % (label, count, bar))
+
+
+# Prints loss rate and latency histogram per player from a gateway log, e.g. python latency_report.py < gateway.log
+if __name__ == "__main__":
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    print_report(collect(source))
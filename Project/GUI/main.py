@@ -5,7 +5,7 @@ import logging
 import math
 import signal
 import sys
-from datetime import datetime
+from datetime import datetime, timedelta
 from pathlib import Path
 from random import randint
 from typing import List
@@ -421,21 +421,27 @@ class MainWindow(QMainWindow):
             json_data = json.loads(packet)
             LOGGER.info(json_data)
 
-            if "Entry 1" in json_data:
+            # The firmware prints one routing table entry per line
+            if any(key.startswith("Entry ") for key in json_data):
                 routing_table = json_data
                 self.nodes_widget.update_nodes(routing_table)
                 LOGGER.info("Routing Received")
 
             elif "Force" in json_data:
-                player_data = {"player": str(json_data["Path"])[0], "pressure": json_data["Force"],
+                # The path is a list of node ids starting with the player, the origin tells players apart
+                path = [str(hop) for hop in json_data["Path"]]
+                player = str(json_data["Origin"])
+                player_data = {"player": player, "pressure": json_data["Force"],
                                "oximeter": json_data["Oximeter"], "battery": json_data["Battery"]}
                 self.message_widget.update_message(player_data)
-                self.nodes_widget.draw_path(list(str(json_data["Path"])))
+                self.nodes_widget.draw_path(path)
 
-                message = f'Player: {str(json_data["Path"])[0]}, Pressure: {json_data["Force"]}, ' \
+                message = f'Player: {player}, Pressure: {json_data["Force"]}, ' \
                           f'Heart Rate: {json_data["Oximeter"]}, Battery Level: {json_data["Battery"]}, ' \
-                          f'Path: [{"->".join(list(str(json_data["Path"])))}]'
-                timestamp = datetime.now().strftime("%Y-%m-%d %H:%M:%S")
+                          f'Path: [{"->".join(path)}]'
+                # The age tells how long ago the sample was taken, samples of a batch arrive together
+                taken = datetime.now() - timedelta(milliseconds=json_data.get("Age", 0))
+                timestamp = taken.strftime("%Y-%m-%d %H:%M:%S.%f")[:-3]
 
                 self.message_widget.add_message_to_list(timestamp=timestamp, message=message)
 
@@ -53,6 +53,8 @@ class DataGenerator:
     def __init__(self, max_nodes = MAX_NO_OF_NODES):
         self.max_nodes = max_nodes
         self.node_addresses = [(random.randint(0, 255), random.randint(0, 255)) for i in range(max_nodes)]
+        self.seqnos = {}
+        self.origins = {}
 
     @staticmethod
     def generate_random_path(max_length):
@@ -70,13 +72,28 @@ class DataGenerator:
         force = random.randint(0, 2000)
         oximeter = random.randint(40, 170)
         battery_level = random.randint(3000, 3700)
-        path = int(''.join(map(str, self.generate_random_path(max_length=5))))
+        path = self.generate_random_path(max_length=5)
+        rssi = [0] + [random.randint(-90, -40) for _ in path[1:]]
+        # Every player numbers its own readings, now and then one of them gets lost
+        origin = path[0]
+        self.seqnos[origin] = (self.seqnos.get(origin, 0) + random.choice([1, 1, 1, 1, 2])) % 256
+        # The device id is taken from the link-layer address, the node id in the path only from its last byte
+        self.origins.setdefault(origin, random.randint(0, 255) << 8 | origin)
 
         sensor_message = {
             "Force": force,
             "Oximeter": oximeter,
+            "ForceRange": [max(0, force - random.randint(0, 200)), force + random.randint(0, 400)],
+            "OximeterRange": [max(0, oximeter - random.randint(0, 10)), oximeter + random.randint(0, 10)],
+            "Origin": self.origins[origin],
+            "Seq": self.seqnos[origin],
+            "Sample": 0,
+            "Age": random.randint(5, 40) * len(path),
             "Path": path,
+            "RSSI": rssi,
+            "Truncated": False,
             "Battery": battery_level,
+            "Interval": random.choice([250, 500, 1000, 5000]),
         }
         return sensor_message
 
@@ -133,16 +150,18 @@ def main():
             routing_table = d.generate_routing_table()
 
             sensor_packet = json.dumps(sensor_message) + "\r\n"
-            routing_table_packet = json.dumps(routing_table) + "\r\n"
 
             print(f"Writing Packet {sensor_packet}, {len(sensor_message)=}")
             virtual_device.write_packet(sensor_packet)
             print(f"Packet {sensor_packet} written")
             time.sleep(1)
             
-            print(f"Writing Packet {routing_table_packet}, {len(routing_table_packet)=}")
-            virtual_device.write_packet(routing_table_packet)
-            print(f"Packet {routing_table_packet} written")
+            # The firmware prints one routing table entry per line
+            for key, entry in routing_table.items():
+                routing_table_packet = json.dumps({key: entry}) + "\r\n"
+                print(f"Writing Packet {routing_table_packet}, {len(routing_table_packet)=}")
+                virtual_device.write_packet(routing_table_packet)
+                print(f"Packet {routing_table_packet} written")
             time.sleep(1)
 
             
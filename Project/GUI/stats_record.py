@@ -0,0 +1,98 @@
+import sys
+import struct
+
+# Must match PROTOCOL_VERSION, MSG_TYPE_STATS and enum stats_counter in protocol.h
+PROTOCOL_VERSION = 13
+MSG_TYPE_STATS = 4
+STATS_PREFIX = "STATS "
+
+COUNTER_NAMES = [
+    "rx_data_frames",
+    "rx_data_messages",
+    "rx_control_frames",
+    "tx_data_frames",
+    "tx_control_frames",
+    "forwarded",
+    "delivered",
+    "retransmissions",
+    "drop_malformed",
+    "drop_duplicate",
+    "drop_no_route",
+    "drop_queue_full_normal",
+    "drop_queue_full_urgent",
+    "drop_retries",
+    "radio_busy",
+    "collisions",
+    "control_deferred",
+    "drop_log",
+]
+
+HEADER_FORMAT = "<BBI%dHBBBBB" % len(COUNTER_NAMES)
+NEIGHBOR_FORMAT = "<BBHHHBb"
+
+
+def decode_stats_record(line):
+    """Decodes a "STATS <hex>" line printed by a switch, returns None for any other line."""
+    line = line.strip()
+    if not line.startswith(STATS_PREFIX):
+        return None
+    try:
+        data = bytes.fromhex(line[len(STATS_PREFIX):])
+    except ValueError:
+        return None
+
+    header_len = struct.calcsize(HEADER_FORMAT)
+    if len(data) < header_len or data[0] != (PROTOCOL_VERSION << 4) | MSG_TYPE_STATS:
+        return None
+
+    fields = struct.unpack_from(HEADER_FORMAT, data)
+    counters = fields[3:3 + len(COUNTER_NAMES)]
+    queue_normal, queue_urgent, pool_high_water, pool_size, num_neighbors = fields[3 + len(COUNTER_NAMES):]
+
+    record = {
+        "node": fields[1],
+        "uptime": fields[2],
+        "counters": dict(zip(COUNTER_NAMES, counters)),
+        "queue_high_water": [queue_normal, queue_urgent],
+        "pool_high_water": pool_high_water,
+        "pool_size": pool_size,
+        "neighbors": [],
+    }
+
+    neighbor_len = struct.calcsize(NEIGHBOR_FORMAT)
+    for i in range(num_neighbors):
+        offset = header_len + i * neighbor_len
+        if offset + neighbor_len > len(data):
+            break
+        addr0, addr1, delivered, retransmissions, lost, etx, rssi = struct.unpack_from(NEIGHBOR_FORMAT, data, offset)
+        record["neighbors"].append({
+            "address": "%d.%d" % (addr0, addr1),
+            "delivered": delivered,
+            "retransmissions": retransmissions,
+            "lost": lost,
+            "etx": etx / 8.0,
+            "rssi": rssi,
+        })
+
+    return record
+
+
+def print_stats_record(record):
+    print("Switch %d, up %d s" % (record["node"], record["uptime"]))
+    for name in COUNTER_NAMES:
+        print("  %-22s %u" % (name, record["counters"][name]))
+    print("  queue high water       %d normal, %d urgent" % tuple(record["queue_high_water"]))
+    print("  pool high water        %d of %d" % (record["pool_high_water"], record["pool_size"]))
+    for neighbor in record["neighbors"]:
+        print("  neighbor %-8s delivered %u, retransmissions %u, lost %u, ETX %.2f, RSSI %d dBm" % (
+            neighbor["address"], neighbor["delivered"], neighbor["retransmissions"], neighbor["lost"],
+            neighbor["etx"], neighbor["rssi"]))
+
+
+# Prints the statistics records found in a serial log, e.g. python stats_record.py < switch.log
+if __name__ == "__main__":
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    for line in source:
+        record = decode_stats_record(line)
+        if record is not None:
+            print_stats_record(record)
@@ -0,0 +1,129 @@
+/**
+ * @file log.c
+ * @brief Non-blocking serial output for the log messages and the GUI output.
+ */
+
+#include "log.h"
+
+#include <stdarg.h> // For va_list.
+#include <stdio.h> // For vsnprintf and putchar.
+
+#if CONTIKI_TARGET_ZOUL || CONTIKI_TARGET_CC2538DK
+#include "dev/uart.h"
+#include "reg.h"
+#endif
+
+/** @addtogroup log
+ * @{
+ */
+
+#if CONTIKI_TARGET_ZOUL || CONTIKI_TARGET_CC2538DK
+#if DBG_CONF_UART == 1
+#define LOG_UART_BASE UART_1_BASE /**< UART printf writes to */
+#else
+#define LOG_UART_BASE UART_0_BASE /**< UART printf writes to */
+#endif
+/** Checks whether the transmit FIFO of the UART is full */
+#define LOG_UART_FULL() (REG(LOG_UART_BASE | UART_FR) & UART_FR_TXFF)
+/** Hands a byte to the transmit FIFO of the UART */
+#define LOG_UART_WRITE(c) (REG(LOG_UART_BASE | UART_DR) = (c))
+#define LOG_DRAIN_MAX LOG_BUFFER_SIZE /**< Bytes written per run, stops early once the FIFO is full */
+#else
+// Without access to the FIFO every byte blocks, so only a few are written per run
+#define LOG_UART_FULL() 0
+#define LOG_UART_WRITE(c) putchar(c)
+#define LOG_DRAIN_MAX 8
+#endif
+
+PROCESS(log_process, "Log Process");
+
+/** Ring buffer of the output that is not written yet, starts out as if a line had just ended */
+static char buffer[LOG_BUFFER_SIZE] = { [LOG_BUFFER_SIZE - 1] = '\n' };
+static uint16_t head = 0; /**< Next position written by log_printf() */
+static uint16_t tail = 0; /**< Next position written to the UART */
+static uint8_t line_dropped = 0; /**< Flag to indicate that part of the current line was dropped */
+static uint16_t dropped = 0; /**< Number of lines cut off */
+
+/**
+ * @brief Gets the free space of the ring buffer
+ * @return Number of bytes that can be buffered
+ */
+static uint16_t log_free(void) {
+  // One byte stays unused to tell a full buffer from an empty one
+  return (tail - head - 1) & (LOG_BUFFER_SIZE - 1);
+}
+
+uint16_t log_space(void) {
+  // One more byte is kept to end a line that gets cut off
+  return log_free() > 0 ? log_free() - 1 : 0;
+}
+
+int log_printf(const char *format, ...) {
+  char line[LOG_LINE_MAX];
+  va_list ap;
+  int len;
+  int i;
+
+  va_start(ap, format);
+  len = vsnprintf(line, sizeof(line), format, ap);
+  va_end(ap);
+  if (len <= 0) {
+    return 0;
+  }
+  if (len >= (int)sizeof(line)) {
+    len = sizeof(line) - 1;
+  }
+
+  // Once part of a line was dropped, the rest of it goes too, but one byte is kept to end what was buffered of it
+  if (line_dropped || len > log_space()) {
+    if (!line_dropped) {
+      dropped++;
+    }
+    line_dropped = line[len - 1] != '\n';
+    if (!line_dropped && buffer[(head - 1) & (LOG_BUFFER_SIZE - 1)] != '\n' && log_free() > 0) {
+      buffer[head] = '\n';
+      head = (head + 1) & (LOG_BUFFER_SIZE - 1);
+      process_poll(&log_process);
+    }
+    return 0;
+  }
+
+  for (i = 0; i < len; i++) {
+    buffer[head] = line[i];
+    head = (head + 1) & (LOG_BUFFER_SIZE - 1);
+  }
+  process_poll(&log_process);
+
+  return len;
+}
+
+uint16_t log_dropped(void) {
+  return dropped;
+}
+
+/**
+ * @brief Log process writes the ring buffer to the UART while its FIFO has room
+ *
+ * The process polls itself as long as output is left, so other processes run in between.
+ */
+PROCESS_THREAD(log_process, ev, data) {
+  static uint16_t written;
+
+  PROCESS_BEGIN();
+
+  while (1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+    for (written = 0; tail != head && written < LOG_DRAIN_MAX && !LOG_UART_FULL(); written++) {
+      LOG_UART_WRITE(buffer[tail]);
+      tail = (tail + 1) & (LOG_BUFFER_SIZE - 1);
+    }
+    if (tail != head) {
+      process_poll(&log_process);
+    }
+  }
+
+  PROCESS_END();
+}
+
+/** @} */
@@ -0,0 +1,72 @@
+/**
+ * @file log.h
+ * @brief Compile-time log levels and non-blocking serial output shared by node.c and switch_gateway.c.
+ *
+ * Messages below LOG_LEVEL are removed by the compiler, the remaining ones and the output for the GUI are formatted
+ * into a ring buffer that log_process drains while the UART has room, so radio callbacks never wait on the serial line.
+ * When the buffer is full, the rest of the line is dropped and only its newline is kept, so the GUI never sees two
+ * lines run into each other. Output that must not be lost is printed from a process that waits for log_space().
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include "contiki.h"
+
+/**
+ * @defgroup log Log
+ * @brief Log levels and buffered serial output.
+ */
+
+/**@{*/
+
+#define LOG_LEVEL_NONE 0 /**< No log messages */
+#define LOG_LEVEL_ERR 1 /**< Errors the device cannot recover from */
+#define LOG_LEVEL_WARN 2 /**< Lost packets and other conditions the device recovers from */
+#define LOG_LEVEL_INFO 3 /**< Periodic reports and routing changes */
+#define LOG_LEVEL_DBG 4 /**< Every received and sent packet */
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO /**< Highest level that is compiled in, e.g. make LOG_LEVEL=4 for a debug build */
+#endif
+
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 1024 /**< Size of the serial output ring buffer, a power of two, holds three full GUI lines */
+#endif
+
+#ifndef LOG_LINE_MAX
+#define LOG_LINE_MAX 192 /**< Longest output of a single log_printf() call, longer output is truncated */
+#endif
+
+/** Logs a message if its level is compiled in, the arguments are still type checked if it is not */
+#define LOG_AT(level, ...) do { if (LOG_LEVEL >= (level)) { log_printf(__VA_ARGS__); } } while (0)
+
+#define LOG_ERR(...) LOG_AT(LOG_LEVEL_ERR, __VA_ARGS__) /**< Logs an error */
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__) /**< Logs a warning */
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__) /**< Logs an informational message */
+#define LOG_DBG(...) LOG_AT(LOG_LEVEL_DBG, __VA_ARGS__) /**< Logs a debug message */
+
+PROCESS_NAME(log_process);
+
+/**
+ * @brief Formats output into the serial ring buffer, used directly for the output the GUI and host tools parse
+ * @param format printf format
+ * @return Number of bytes buffered, 0 if the output was dropped
+ */
+int log_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * @brief Gets the number of bytes log_printf() can buffer right now
+ * @return Free space of the ring buffer
+ */
+uint16_t log_space(void);
+
+/**
+ * @brief Gets the number of lines that were cut off because the ring buffer was full
+ * @return Number of dropped lines
+ */
+uint16_t log_dropped(void);
+
+/**@}*/
+
+#endif /* LOG_H */
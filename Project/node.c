@@ -18,8 +18,12 @@
 #include "dev/adc-zoul.h"      // ADC
 #include "dev/zoul-sensors.h"  // Sensor functions
 #include "dev/sys-ctrl.h"
+#include "sys/energest.h"      // Radio-on time for the benchmark
 // Standard C includes:
-#include <stdio.h>      // For printf.
+#include <string.h>     // For memmove.
+// Project includes:
+#include "protocol.h"   // Shared messages and wire format
+#include "log.h"        // Log levels and buffered serial output
 
 /**
  * @defgroup node SensorNode
@@ -33,61 +37,241 @@
 
 // MAC LAYER PARAMETERS
 //#define NETSTACK_CONF_MAC nullmac_driver
+// The radio duty cycling profile is selected in project-conf.h
 
 /**
- * @def NETSTACK_CONF_RDC
- * @brief Definition for NullRDC driver.
+ * @def MAX_RETRIES
+ * @brief Maximum number of retransmissions of a sensor message that was not acknowledged.
  */
 
 /**
- * @def MAX_RETRIES
- * @brief Maximum number of retries for a process.
+ * @def RETRY_BACKOFF
+ * @brief Backoff before the first retransmission, doubled with every further one.
  */
 
+#define MAX_RETRIES 3
+#define RETRY_BACKOFF (CLOCK_SECOND / 16)
+
 /**
- * @def MAX_NODES
- * @brief Maximum number of nodes in the network.
+ * @def URGENT_FORCE_THRESHOLD
+ * @brief Raw force reading at or above which a message is sent as urgent.
  */
-#define NETSTACK_CONF_RDC nullrdc_driver
-#define MAX_RETRIES 3
-#define MAX_NODES 5
 
-static uint16_t adc1_value, adc3_value, batteryvolt;
-static int16_t max_rssi = -100;
-static linkaddr_t best_rssi_switch;
+/**
+ * @def URGENT_OXIMETER_THRESHOLD
+ * @brief Raw heart-rate reading at or above which a message is sent as urgent.
+ */
+#ifndef URGENT_FORCE_THRESHOLD
+#define URGENT_FORCE_THRESHOLD 1800
+#endif
+#ifndef URGENT_OXIMETER_THRESHOLD
+#define URGENT_OXIMETER_THRESHOLD 1800
+#endif
 
-PROCESS(example_unicast_process, "Runicast Example");
-AUTOSTART_PROCESSES(&example_unicast_process);
-int32_t node_number = 1;
+/**
+ * @def ACQUISITION_RATE
+ * @brief Rate in Hz the rtimer samples the sensors at. With ContikiMAC the rtimer belongs to the MAC layer, the
+ * sensors are then sampled by a ctimer at up to CLOCK_SECOND Hz.
+ */
 
 /**
- * @struct sensor_message
- * @brief Represents a message from a sensor device.
+ * @def SAMPLE_BUFFER_SIZE
+ * @brief Number of samples the ring buffer holds until they are decimated, a power of two.
  */
-struct sensor_message {
-  int16_t force;          /**< The force measurement value. */
-  int16_t oximeter;       /**< The oximeter measurement value. */
-  int32_t path;           /**< The path measurement value. */
-  uint16_t batteryLevel;  /**< The battery level of the sensor device. */
-};
 
+/**
+ * @def SMOOTHING_SHIFT
+ * @brief Log2 of the number of samples the moving average for the minimum and peak readings runs over.
+ */
 
 /**
- * @struct routing_entry
- * @brief Holds an entry in the routing table.
- *
- * This structure represents a single entry in the routing table,
- * holding various details about a node in the network.
- */
-struct routing_entry {
-  linkaddr_t node_address; /**< Address of the node. */
-  uint8_t hops; /**< Number of hops to reach the node. */
-  linkaddr_t next_hop; /**< Address of the next hop to reach the node. */
-  int8_t node_id; /**< Unique identifier of the node. */
-  char node_type; /**< Type of the node (e.g., 'G' for Gateway, 'N' for normal node). */
-  uint8_t still_active; /**< Flag to indicate if the node is still active in the network. */
+ * @def SAMPLE_INTERVAL
+ * @brief Interval the samples are decimated and checked for a report at.
+ */
+
+/**
+ * @def REPORT_MIN_INTERVAL
+ * @brief Minimum interval between two reports, limits the airtime of a player that keeps moving.
+ */
+
+/**
+ * @def REPORT_MAX_INTERVAL
+ * @brief Interval after which a report is sent even if the readings did not change.
+ */
+
+/**
+ * @def REPORT_JITTER
+ * @brief Random time added to REPORT_MAX_INTERVAL.
+ */
+
+/**
+ * @def FORCE_CHANGE_THRESHOLD
+ * @brief Change of the raw force reading since the last report that triggers a new one.
+ */
+
+/**
+ * @def OXIMETER_CHANGE_THRESHOLD
+ * @brief Change of the raw heart-rate reading since the last report that triggers a new one.
+ */
+
+/**
+ * @def MAX_SWITCHES
+ * @brief Number of switches the neighbor table keeps track of.
+ */
+
+/**
+ * @def NEIGHBOR_RSSI_SHIFT
+ * @brief A new RSSI sample of a switch is weighted 2^-NEIGHBOR_RSSI_SHIFT against its average.
+ */
+
+/**
+ * @def NEIGHBOR_TIMEOUT
+ * @brief Time after which a switch that was not heard from is dropped, three advertisement intervals.
+ */
+
+/**
+ * @def PARENT_HYSTERESIS
+ * @brief Margin in dBm by which another switch has to be stronger than the parent to take over.
+ */
+
+/**
+ * @def ENERGY_REPORT_INTERVAL
+ * @brief Interval of the energy summaries piggybacked on the sensor messages.
+ */
+
+/**
+ * @def BENCHMARK_INTERVAL
+ * @brief Interval of the benchmark reports, only used by the benchmark build.
+ */
+
+/**
+ * @def BATCH_SAMPLES
+ * @brief Number of samples sent in one batch, taken every SAMPLE_INTERVAL. Set to 0 to report on change instead.
+ */
+#if RDC_OWNS_RTIMER
+#ifndef ACQUISITION_RATE
+#define ACQUISITION_RATE 32
+#endif
+#define ACQUISITION_PERIOD (CLOCK_SECOND / ACQUISITION_RATE)
+#else
+#ifndef ACQUISITION_RATE
+#define ACQUISITION_RATE 256
+#endif
+#define ACQUISITION_PERIOD (RTIMER_SECOND / ACQUISITION_RATE)
+#endif
+#ifndef SAMPLE_BUFFER_SIZE
+#define SAMPLE_BUFFER_SIZE 64
+#endif
+#ifndef SMOOTHING_SHIFT
+#define SMOOTHING_SHIFT 2
+#endif
+#ifndef SAMPLE_INTERVAL
+#define SAMPLE_INTERVAL (CLOCK_SECOND / 8)
+#endif
+#ifndef REPORT_MIN_INTERVAL
+#define REPORT_MIN_INTERVAL (CLOCK_SECOND / 4)
+#endif
+#ifndef REPORT_MAX_INTERVAL
+#define REPORT_MAX_INTERVAL (CLOCK_SECOND * 5)
+#endif
+#ifndef REPORT_JITTER
+#define REPORT_JITTER (CLOCK_SECOND / 2)
+#endif
+#ifndef FORCE_CHANGE_THRESHOLD
+#define FORCE_CHANGE_THRESHOLD 100
+#endif
+#ifndef OXIMETER_CHANGE_THRESHOLD
+#define OXIMETER_CHANGE_THRESHOLD 40
+#endif
+#ifndef MAX_SWITCHES
+#define MAX_SWITCHES 8
+#endif
+#define NEIGHBOR_RSSI_SHIFT 2
+#ifndef NEIGHBOR_TIMEOUT
+#define NEIGHBOR_TIMEOUT (CLOCK_SECOND * 15)
+#endif
+#ifndef PARENT_HYSTERESIS
+#define PARENT_HYSTERESIS 4
+#endif
+#ifndef ENERGY_REPORT_INTERVAL
+#define ENERGY_REPORT_INTERVAL (CLOCK_SECOND * 30)
+#endif
+#ifndef BENCHMARK_INTERVAL
+#define BENCHMARK_INTERVAL (CLOCK_SECOND * 60)
+#endif
+#ifndef BATCH_SAMPLES
+#define BATCH_SAMPLES 0
+#endif
+#if BATCH_SAMPLES > BATCH_MAX_SAMPLES
+#error "BATCH_SAMPLES must not exceed BATCH_MAX_SAMPLES"
+#endif
+
+/** Raw sample of both sensors taken by the acquisition rtimer */
+struct adc_sample {
+  uint16_t force; /**< Force reading, 12 bit */
+  uint16_t oximeter; /**< Heart-rate reading, 12 bit */
 };
 
+/** Decimation state of one sensor */
+struct sample_filter {
+  uint16_t history[1 << SMOOTHING_SHIFT]; /**< Last samples, for the moving average */
+  uint16_t history_sum; /**< Sum of the samples in history */
+  uint8_t history_index; /**< Position of the oldest sample in history */
+  uint8_t primed; /**< Flag to indicate that history holds real samples */
+  uint32_t sum; /**< Sum of the samples since the value was last taken */
+  uint16_t count; /**< Number of samples since the value was last taken */
+  uint16_t min; /**< Lowest moving average since the range was last reset */
+  uint16_t max; /**< Peak moving average since the range was last reset */
+};
+
+static struct adc_sample sample_buffer[SAMPLE_BUFFER_SIZE]; /**< Ring buffer filled by the acquisition rtimer */
+static volatile uint8_t sample_head = 0; /**< Next slot of the ring buffer written by the rtimer */
+static volatile uint8_t sample_tail = 0; /**< Next slot of the ring buffer read by the process */
+static volatile uint16_t samples_overrun = 0; /**< Number of samples lost because the ring buffer was full */
+#if RDC_OWNS_RTIMER
+static struct ctimer acquisition_timer; /**< Timer of the acquisition loop */
+#else
+static struct rtimer acquisition_timer; /**< Timer of the acquisition loop */
+#endif
+static struct sample_filter force_filter; /**< Decimation state of the force sensor */
+static struct sample_filter oximeter_filter; /**< Decimation state of the heart-rate sensor */
+
+/** Switch in range of the node */
+struct neighbor {
+  linkaddr_t address; /**< Address of the switch */
+  int16_t rssi; /**< Average RSSI of its advertisements in 1/8 dBm */
+  clock_time_t last_heard; /**< Time its last advertisement was received */
+};
+
+static struct neighbor neighbors[MAX_SWITCHES]; /**< Switches in range of the node */
+static int num_neighbors = 0; /**< Number of entries in neighbors */
+static struct neighbor *parent = NULL; /**< Switch the sensor messages are sent to, NULL until one was heard */
+
+static uint16_t adc1_value, adc3_value, batteryvolt;
+static uint8_t message_seqno = 0; /**< Sequence number of the next sensor message */
+static uint8_t message_epoch; /**< Random number picked at boot, lets the switches tell a restart from a duplicate */
+static struct sensor_message last_message; /**< Last sensor message, kept until it is acknowledged */
+static clock_time_t last_message_time; /**< Time the reading of the last sensor message was taken */
+static uint8_t retries; /**< Number of retransmissions of the last sensor message */
+static struct ctimer retry_timer; /**< Timer for the next retransmission of the last sensor message */
+static uint16_t messages_delivered = 0; /**< Number of sensor messages acknowledged by a switch */
+static uint16_t messages_retransmitted = 0; /**< Number of retransmissions */
+static uint16_t messages_lost = 0; /**< Number of sensor messages given up on */
+static uint8_t reported = 0; /**< Flag to indicate that a report was sent since boot */
+static uint16_t reported_force; /**< Raw force reading of the last report */
+static uint16_t reported_oximeter; /**< Raw heart-rate reading of the last report */
+static clock_time_t last_report_time; /**< Time of the last report */
+static clock_time_t report_max_interval; /**< Interval after which the next report is sent anyway */
+static struct timer energy_timer; /**< Timer for the next energy summary */
+#if BATCH_SAMPLES > 1
+static struct sensor_sample batch[BATCH_SAMPLES]; /**< Samples waiting to be sent, oldest first */
+static int batch_count = 0; /**< Number of samples waiting to be sent */
+static clock_time_t batch_time; /**< Time the oldest waiting sample was taken */
+#endif
+
+PROCESS(example_unicast_process, "Runicast Example");
+AUTOSTART_PROCESSES(&example_unicast_process, &log_process);
+uint8_t node_number; /**< Id of the player in the path of its messages, set from the link-layer address at boot */
 
 /**
  * @brief Callback function for receiving unicast messages.
@@ -100,50 +284,139 @@ struct routing_entry {
  */
 static void recv_unicast(struct unicast_conn *c, const linkaddr_t *from, uint8_t seqno)
 {
-  printf("Received unicast message from %d.%d: '%s'\n",
-         from->u8[0], from->u8[1], (char *)packetbuf_dataptr());
+  LOG_DBG("Received unicast message from %d.%d, len: %u\n", from->u8[0], from->u8[1], packetbuf_datalen());
+}
+
+/**
+ * @brief Feeds the RSSI of an advertisement into the neighbor table.
+ *
+ * A switch that is not in the table yet takes a free slot, or the slot of the switch that was not heard from the
+ * longest.
+ *
+ * @param addr The address of the switch.
+ * @param rssi The RSSI of the advertisement in dBm.
+ */
+static void neighbor_update(const linkaddr_t *addr, int16_t rssi)
+{
+  clock_time_t now = clock_time();
+  int slot = -1;
+  int i;
+
+  for (i = 0; i < num_neighbors; i++) {
+    if (linkaddr_cmp(&neighbors[i].address, addr)) {
+      neighbors[i].rssi += (rssi * 8 - neighbors[i].rssi) >> NEIGHBOR_RSSI_SHIFT;
+      neighbors[i].last_heard = now;
+      return;
+    }
+  }
+
+  if (num_neighbors < MAX_SWITCHES) {
+    slot = num_neighbors++;
+  } else {
+    slot = 0;
+    for (i = 1; i < num_neighbors; i++) {
+      if (now - neighbors[i].last_heard > now - neighbors[slot].last_heard) {
+        slot = i;
+      }
+    }
+  }
+
+  // The parent may only be replaced if it went silent the longest
+  if (parent == &neighbors[slot]) {
+    parent = NULL;
+  }
+  linkaddr_copy(&neighbors[slot].address, addr);
+  neighbors[slot].rssi = rssi * 8;
+  neighbors[slot].last_heard = now;
+}
+
+/**
+ * @brief Picks the switch the next sensor message is sent to.
+ *
+ * Switches that were not heard from within NEIGHBOR_TIMEOUT are dropped first. The parent is kept until another switch
+ * is stronger by PARENT_HYSTERESIS or the parent times out, so switches with a similar RSSI do not take turns.
+ *
+ * @return The parent, or NULL if no switch is in range.
+ */
+static struct neighbor *parent_select(void)
+{
+  clock_time_t now = clock_time();
+  struct neighbor *best = NULL;
+  int i = 0;
+
+  while (i < num_neighbors) {
+    if (now - neighbors[i].last_heard > NEIGHBOR_TIMEOUT) {
+      LOG_INFO("switch %02x:%02x timed out\n", neighbors[i].address.u8[0], neighbors[i].address.u8[1]);
+      num_neighbors--;
+      if (parent == &neighbors[i]) {
+        parent = NULL;
+      } else if (parent == &neighbors[num_neighbors]) {
+        parent = &neighbors[i];
+      }
+      neighbors[i] = neighbors[num_neighbors];
+      continue;
+    }
+    if (best == NULL || neighbors[i].rssi > best->rssi) {
+      best = &neighbors[i];
+    }
+    i++;
+  }
+
+  if (best != NULL && best != parent &&
+      (parent == NULL || best->rssi > parent->rssi + PARENT_HYSTERESIS * 8)) {
+    parent = best;
+    LOG_INFO("new parent %02x:%02x, RSSI %d\n", parent->address.u8[0], parent->address.u8[1], parent->rssi / 8);
+  }
+
+  return parent;
 }
 
 /**
  * @brief Callback function for receiving broadcast messages.
  *
- * This function is called when a broadcast message is received by the node. The node checks for the best rssi from the broadcast 
- * messages it gets from the switches and choses one with the least rssi. For demonstation the node doesn't directly send to the 
- * gateway even if it is within range due to room size.
+ * This function is called when a broadcast message is received by the node. The node keeps an RSSI average of every
+ * switch it hears from, parent_select() picks the switch to send to from them. For demonstation the node doesn't
+ * directly send to the gateway even if it is within range due to room size.
  *
  * @param c The broadcast connection.
  * @param from The address of the sender.
  */
 static void broadcast_recv(struct broadcast_conn *c, const linkaddr_t *from) {
   int16_t rssi = packetbuf_attr(PACKETBUF_ATTR_RSSI);
- struct routing_entry received_table[MAX_NODES];
-    packetbuf_copyto(&received_table);
-	printf("Node type is : %c", received_table[0].node_type);
-    if(received_table[0].node_type =='G')
+  // Routing frames always start with the entry of the sender
+  struct routing_entry sender_entry;
+  if (routing_frame_decode(packetbuf_dataptr(), packetbuf_datalen(), &sender_entry, 1) == 0) {
+    return;
+  }
+  LOG_DBG("Node type is : %c\n", sender_entry.node_type);
+    if(sender_entry.node_type =='G')
     {
       return;
     }
     
-  if (rssi > max_rssi) {
-    max_rssi = rssi;
-    linkaddr_copy(&best_rssi_switch, from);
-    printf("best rssi from  %02x:%02x\n", best_rssi_switch.u8[0], best_rssi_switch.u8[1]);
-  }
+  neighbor_update(from, rssi);
 
   leds_on(LEDS_GREEN);
 
-  uint8_t len = strlen((char *)packetbuf_dataptr());
-  printf("Got RX packet (broadcast) from: 0x%x%x, len: %d, RSSI: %d\r\n", from->u8[0], from->u8[1], len, rssi);
-  printf("Received string: ");
-  copy_and_print_packetbuffer();
+  LOG_DBG("Got RX packet (broadcast) from: 0x%x%x, len: %u, RSSI: %d\r\n", from->u8[0], from->u8[1],
+          packetbuf_datalen(), rssi);
 
   leds_off(LEDS_GREEN);
 }
 
+/**
+ * @brief Callback function called by the MAC layer once a sensor message was sent.
+ *
+ * @param c The unicast connection.
+ * @param status MAC_TX_OK if the message was acknowledged.
+ * @param num_tx The number of transmissions.
+ */
+static void sent_unicast(struct unicast_conn *c, int status, int num_tx);
+
 /**
  * @brief Unicast callbacks structure.
  */
-static const struct unicast_callbacks unicast_callbacks = {recv_unicast};
+static const struct unicast_callbacks unicast_callbacks = {recv_unicast, sent_unicast};
 
 /**
  * @brief Unicast connection structure.
@@ -160,6 +433,230 @@ static struct broadcast_conn broadcastConn;
  */
 static const struct broadcast_callbacks broadcast_callbacks = {broadcast_recv};
 
+/**
+ * @brief Sends the last sensor message to the parent switch.
+ *
+ * The MAC layer makes a single attempt, retransmissions are scheduled by sent_unicast(). A retransmission goes to the
+ * parent at that time. Without a parent the attempt counts as failed, so the message waits for a switch to show up.
+ *
+ * @param ptr Unused.
+ */
+static void send_last_message(void *ptr)
+{
+  uint8_t buf[SENSOR_MESSAGE_MAX_LEN];
+  uint16_t length;
+
+  // The age covers the retransmissions, so the gateway sees how old the reading really is
+  last_message.age = 0;
+  sensor_message_add_age(&last_message, clock_time() - last_message_time);
+  length = sensor_message_encode(buf, &last_message);
+
+  packetbuf_copyfrom(buf, length);
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS, 1);
+
+  if (parent_select() == NULL) {
+    LOG_WARN("no switch in range\n");
+    sent_unicast(&unicast, MAC_TX_NOACK, 0);
+    return;
+  }
+
+  LOG_DBG("sent to parent %02x:%02x\n", parent->address.u8[0], parent->address.u8[1]);
+  unicast_send(&unicast, &parent->address);
+}
+
+static void sent_unicast(struct unicast_conn *c, int status, int num_tx)
+{
+  if (status == MAC_TX_OK) {
+    messages_delivered++;
+    return;
+  }
+
+  if (retries >= MAX_RETRIES) {
+    messages_lost++;
+    LOG_WARN("Message %u lost after %u retransmissions (%u delivered, %u retransmissions, %u lost)\n",
+             last_message.seqno, retries, messages_delivered, messages_retransmitted, messages_lost);
+    return;
+  }
+
+  // Back off exponentially, with a random jitter so that nodes that collided do not collide again
+  ctimer_set(&retry_timer, (RETRY_BACKOFF << retries) + random_rand() % RETRY_BACKOFF, send_last_message, NULL);
+  retries++;
+  messages_retransmitted++;
+}
+
+/**
+ * @brief Stores one sample of both sensors in the ring buffer.
+ */
+static void store_sample(void)
+{
+  uint8_t next = (sample_head + 1) & (SAMPLE_BUFFER_SIZE - 1);
+
+  if (next == sample_tail) {
+    samples_overrun++;
+    return;
+  }
+
+  // Data is in the 12 MSBs
+  sample_buffer[sample_head].force = adc_zoul.value(ZOUL_SENSORS_ADC1) >> 4;
+  sample_buffer[sample_head].oximeter = adc_zoul.value(ZOUL_SENSORS_ADC3) >> 4;
+  sample_head = next;
+}
+
+#if RDC_OWNS_RTIMER
+/**
+ * @brief Takes one sample of both sensors and schedules the next one.
+ *
+ * @param ptr Unused.
+ */
+static void acquire_samples(void *ptr)
+{
+  ctimer_reset(&acquisition_timer);
+  store_sample();
+}
+#else
+/**
+ * @brief Takes one sample of both sensors and schedules the next one.
+ *
+ * Runs from the rtimer interrupt, so it only stores the samples in the ring buffer. They are decimated by the process.
+ *
+ * @param t The acquisition rtimer.
+ * @param ptr Unused.
+ */
+static void acquire_samples(struct rtimer *t, void *ptr)
+{
+  rtimer_clock_t next_time = t->time + ACQUISITION_PERIOD;
+
+  // Keep a fixed rate, unless the timer fell so far behind that the next slot already passed
+  if (RTIMER_CLOCK_LT(next_time, RTIMER_NOW() + 2)) {
+    next_time = RTIMER_NOW() + ACQUISITION_PERIOD;
+  }
+  rtimer_set(t, next_time, 1, acquire_samples, NULL);
+
+  store_sample();
+}
+#endif
+
+/**
+ * @brief Feeds a sample into the decimation state of its sensor.
+ *
+ * The minimum and peak are taken from a moving average over 2^SMOOTHING_SHIFT samples, so single noisy samples do not
+ * show up as peaks.
+ *
+ * @param filter Decimation state of the sensor.
+ * @param value Raw sample.
+ */
+static void sample_filter_add(struct sample_filter *filter, uint16_t value)
+{
+  uint16_t smoothed;
+  uint8_t i;
+
+  if (!filter->primed) {
+    for (i = 0; i < (1 << SMOOTHING_SHIFT); i++) {
+      filter->history[i] = value;
+    }
+    filter->history_sum = value << SMOOTHING_SHIFT;
+    filter->min = filter->max = value;
+    filter->primed = 1;
+  }
+
+  filter->history_sum += value - filter->history[filter->history_index];
+  filter->history[filter->history_index] = value;
+  filter->history_index = (filter->history_index + 1) & ((1 << SMOOTHING_SHIFT) - 1);
+
+  smoothed = filter->history_sum >> SMOOTHING_SHIFT;
+  if (smoothed < filter->min) {
+    filter->min = smoothed;
+  }
+  if (smoothed > filter->max) {
+    filter->max = smoothed;
+  }
+
+  filter->sum += value;
+  filter->count++;
+}
+
+/**
+ * @brief Takes the average of the samples fed in since the last call.
+ *
+ * @param filter Decimation state of the sensor.
+ * @return Average of the samples, or the current moving average if there were none.
+ */
+static uint16_t sample_filter_value(struct sample_filter *filter)
+{
+  uint16_t value = filter->count > 0 ? filter->sum / filter->count : filter->history_sum >> SMOOTHING_SHIFT;
+
+  filter->sum = 0;
+  filter->count = 0;
+  return value;
+}
+
+/**
+ * @brief Starts a new minimum and peak at the current moving average.
+ *
+ * @param filter Decimation state of the sensor.
+ */
+static void sample_filter_reset_range(struct sample_filter *filter)
+{
+  filter->min = filter->max = filter->history_sum >> SMOOTHING_SHIFT;
+}
+
+/**
+ * @brief Decides whether the current readings are reported.
+ *
+ * A report is due once the readings, or their minimum or peak, moved by more than their threshold since the last
+ * report, but not before REPORT_MIN_INTERVAL passed, or once the jittered maximum interval passed.
+ *
+ * @param now Time the readings were taken.
+ * @return 1 if the readings are reported, 0 otherwise.
+ */
+static int report_due(clock_time_t now)
+{
+  clock_time_t elapsed = now - last_report_time;
+
+  if (!reported || elapsed >= report_max_interval) {
+    return 1;
+  }
+  if (elapsed < REPORT_MIN_INTERVAL) {
+    return 0;
+  }
+
+  // Comparing the range catches a spike that is over before the next report
+  return force_filter.max >= reported_force + FORCE_CHANGE_THRESHOLD ||
+         force_filter.min + FORCE_CHANGE_THRESHOLD <= reported_force ||
+         oximeter_filter.max >= reported_oximeter + OXIMETER_CHANGE_THRESHOLD ||
+         oximeter_filter.min + OXIMETER_CHANGE_THRESHOLD <= reported_oximeter;
+}
+
+#ifdef BENCHMARK
+/**
+ * @brief Prints the radio-on time and delivery counters of the node for the benchmark.
+ *
+ * The times are the share of the uptime in permille as measured by Energest. The gateway log tells the latency and
+ * the delivery ratio seen at the other end, GUI/benchmark_report.py puts both together per profile.
+ */
+static void report_benchmark(void)
+{
+  uint64_t total;
+  unsigned long transmit;
+  unsigned long listen;
+
+  energest_flush();
+  total = (uint64_t)energest_type_time(ENERGEST_TYPE_CPU) + energest_type_time(ENERGEST_TYPE_LPM);
+  transmit = energest_type_time(ENERGEST_TYPE_TRANSMIT);
+  listen = energest_type_time(ENERGEST_TYPE_LISTEN);
+  if (total == 0) {
+    return;
+  }
+
+  // Split in two, a single log_printf() call is limited to LOG_LINE_MAX bytes
+  log_printf("BENCH {\"Profile\": \"%s\", \"Node\": %u, \"Uptime\": %lu, \"RadioOn\": %lu, \"Transmit\": %lu, ",
+             RDC_PROFILE_NAME, device_id(&linkaddr_node_addr), clock_seconds(),
+             (unsigned long)((transmit + listen) * 1000ULL / total), (unsigned long)(transmit * 1000ULL / total));
+  log_printf("\"Listen\": %lu, \"Delivered\": %u, \"Retransmitted\": %u, \"Lost\": %u}\n",
+             (unsigned long)(listen * 1000ULL / total), messages_delivered, messages_retransmitted, messages_lost);
+}
+#endif
+
 /**
  * @brief Main process thread for the example unicast process.
  *
@@ -174,6 +671,10 @@ PROCESS_THREAD(example_unicast_process, ev, data)
 
   PROCESS_BEGIN();
 
+  // Players are flashed with the same image, switches and gateways tell them apart by this id and their sequence numbers
+  node_number = linkaddr_node_addr.u8[LINKADDR_SIZE - 1];
+  message_epoch = random_rand();
+
   unicast_open(&unicast, 146, &unicast_callbacks);
 
   /*
@@ -190,85 +691,133 @@ PROCESS_THREAD(example_unicast_process, ev, data)
 
   // Configure the ADC ports 
   adc_zoul.configure(SENSORS_HW_INIT, ZOUL_SENSORS_ADC1 | ZOUL_SENSORS_ADC3);
-
-  static struct etimer reset_timer;
- etimer_set(&reset_timer, CLOCK_SECOND * 10); // Reset every 10 seconds
+#if RDC_OWNS_RTIMER
+  ctimer_set(&acquisition_timer, ACQUISITION_PERIOD, acquire_samples, NULL);
+#else
+  rtimer_set(&acquisition_timer, RTIMER_NOW() + ACQUISITION_PERIOD, 1, acquire_samples, NULL);
+#endif
+
+  static struct etimer sample_timer;
+  etimer_set(&sample_timer, SAMPLE_INTERVAL);
+#ifdef BENCHMARK
+  static struct timer benchmark_timer;
+  timer_set(&benchmark_timer, BENCHMARK_INTERVAL);
+#endif
+  report_max_interval = REPORT_MAX_INTERVAL;
+  timer_set(&energy_timer, ENERGY_REPORT_INTERVAL);
   while (1)
   {
-    static struct etimer et;
-		/* The random interval from 0 to 128 clock ticks (0 to 1 second) */
-	uint8_t randomInterval = random_rand() & 0x8F;
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&sample_timer));
+    etimer_reset(&sample_timer);
 
-    etimer_set(&et, CLOCK_SECOND * 2 + randomInterval);
-
-    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+#ifdef BENCHMARK
+    if (timer_expired(&benchmark_timer)) {
+      timer_reset(&benchmark_timer);
+      report_benchmark();
+    }
+#endif
 
-    // Check if it's time to reset the best_rssi_switch
-   
-    if (etimer_expired(&reset_timer))
-    {
-      linkaddr_copy(&best_rssi_switch, NULL);
-      max_rssi = -100;
-      etimer_reset(&reset_timer);
-      printf("reset timer and best_rssi_switch to NULL");
+    // Decimate the samples the rtimer collected since the last tick
+    while (sample_tail != sample_head) {
+      sample_filter_add(&force_filter, sample_buffer[sample_tail].force);
+      sample_filter_add(&oximeter_filter, sample_buffer[sample_tail].oximeter);
+      sample_tail = (sample_tail + 1) & (SAMPLE_BUFFER_SIZE - 1);
+    }
+    if (!force_filter.primed) {
+      continue;
     }
 
-    // Read ADC values. Data is in the 12 MSBs
-    adc1_value = adc_zoul.value(ZOUL_SENSORS_ADC1) >> 4;
-    adc3_value = adc_zoul.value(ZOUL_SENSORS_ADC3) >> 4;
+    clock_time_t now = clock_time();
+#if BATCH_SAMPLES > 1
+    // Every tick adds a sample, the batch goes out once it is full or an urgent reading shows up
+    if (batch_count == 0) {
+      batch_time = now;
+    }
+    batch[batch_count].force = sample_filter_value(&force_filter);
+    batch[batch_count].oximeter = sample_filter_value(&oximeter_filter);
+    batch[batch_count].batteryLevel = vdd3_sensor.value(CC2538_SENSORS_VALUE_TYPE_CONVERTED);
+    batch_count++;
+    if (batch_count < BATCH_SAMPLES &&
+        force_filter.max < URGENT_FORCE_THRESHOLD && oximeter_filter.max < URGENT_OXIMETER_THRESHOLD) {
+      continue;
+    }
+    adc1_value = batch[batch_count - 1].force;
+    adc3_value = batch[batch_count - 1].oximeter;
+    batteryvolt = batch[batch_count - 1].batteryLevel;
+#else
+    if (!report_due(now)) {
+      continue;
+    }
+    adc1_value = sample_filter_value(&force_filter);
+    adc3_value = sample_filter_value(&oximeter_filter);
 	batteryvolt = vdd3_sensor.value(CC2538_SENSORS_VALUE_TYPE_CONVERTED);
+#endif
 
     // Print Raw values
-    printf("force_raw: %d\n\r", adc1_value); // force sensor
-    printf("heartrate_value_raw: %d\n\r", adc3_value); // heart-rate sensor
-	printf("battery voltage is : %d", batteryvolt);
+    LOG_DBG("force_raw: %d (%d..%d)\n\r", adc1_value, force_filter.min, force_filter.max); // force sensor
+    LOG_DBG("heartrate_value_raw: %d (%d..%d)\n\r", adc3_value, oximeter_filter.min, oximeter_filter.max); // heart-rate sensor
+    if (samples_overrun > 0) {
+      LOG_WARN("%u samples lost to a full sample buffer\n\r", samples_overrun);
+    }
+    LOG_DBG("battery voltage is : %d\n", batteryvolt);
 
     struct sensor_message message;
+    last_message_time = now;
     message.force = adc1_value;
     message.oximeter = adc3_value;
-    message.path = node_number;
+    message.force_min = force_filter.min;
+    message.force_max = force_filter.max;
+    message.oximeter_min = oximeter_filter.min;
+    message.oximeter_max = oximeter_filter.max;
+    message.path_len = 0;
+    message.path_truncated = 0;
+    sensor_message_append_hop(&message, node_number, 0);
 	message.batteryLevel = batteryvolt;
+    message.origin = device_id(&linkaddr_node_addr);
+    message.seqno = message_seqno++;
+    message.epoch = message_epoch;
+    message.priority = (force_filter.max >= URGENT_FORCE_THRESHOLD ||
+                        oximeter_filter.max >= URGENT_OXIMETER_THRESHOLD) ? PRIORITY_URGENT : PRIORITY_NORMAL;
+    message.interval = reported ? (uint32_t)(now - last_report_time) * 1000 / CLOCK_SECOND : 0;
+    message.batch_count = 0;
+    message.has_energy = timer_expired(&energy_timer);
+    if (message.has_energy) {
+      energy_summary_read(&message.energy);
+      timer_reset(&energy_timer);
+    }
+#if BATCH_SAMPLES > 1
+    // The message takes as many samples as fit, the rest start the next batch
+    int sent = sensor_batch_encode(&message, batch, batch_count, (uint32_t)SAMPLE_INTERVAL * 1000 / CLOCK_SECOND);
+    last_message_time = batch_time;
+    batch_count -= sent;
+    batch_time += sent * SAMPLE_INTERVAL;
+    memmove(batch, batch + sent, batch_count * sizeof(batch[0]));
+#endif
+
+    // Remember what was reported, the next report is measured against it
+    reported = 1;
+    reported_force = adc1_value;
+    reported_oximeter = adc3_value;
+    last_report_time = now;
+    sample_filter_reset_range(&force_filter);
+    sample_filter_reset_range(&oximeter_filter);
+    // Jitter the maximum interval so that players at rest do not report in lockstep
+    report_max_interval = REPORT_MAX_INTERVAL + random_rand() % REPORT_JITTER;
+
+    // A fresh reading replaces a message that is still waiting for its retransmission
+    if (!ctimer_expired(&retry_timer)) {
+      ctimer_stop(&retry_timer);
+      messages_lost++;
+    }
+    retries = 0;
 
-    packetbuf_copyfrom(&message, sizeof(struct sensor_message));
-
-    printf("best rssi sent %02x:%02x\n", best_rssi_switch.u8[0], best_rssi_switch.u8[1]);
-    unicast_send(&unicast, &best_rssi_switch);
+    last_message = message;
+    send_last_message(NULL);
   }
 
   PROCESS_END();
 }
 
-/**
- * @brief Prints the content of the packet buffer as a string.
- */
-void print_packetbuffer()
-{
-  char *payload_ptr = packetbuf_dataptr();
-  uint8_t payload_len = strlen(payload_ptr);
-  for (int i = 0; i < payload_len; ++i)
-  {
-    printf("%c", payload_ptr[i]);
-  }
-  printf("\n");
-}
-
-/**
- * @brief Copies and prints the content of the packet buffer.
- */
-void copy_and_print_packetbuffer()
-{
-  // copy the payload of the packetbuffer to a given memory location
-  char *my_buffer = (char *)malloc(packetbuf_datalen());
-  uint16_t my_buffer_len = packetbuf_datalen();
-  packetbuf_copyto(my_buffer);
-  // print the content of the memory location
-  for (int i = 0; i < my_buffer_len; ++i)
-  {
-    printf("%c", my_buffer[i]);
-  }
-  printf("\n");
-  free(my_buffer);
-}
 /**
  * @brief Retrieves the current battery level.
  *
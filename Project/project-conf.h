@@ -0,0 +1,47 @@
+/**
+ * @file project-conf.h
+ * @brief Build configuration shared by node.c and switch_gateway.c.
+ *
+ * Selects the radio duty cycling profile. Player nodes can run ContikiMAC to save their batteries, switches and
+ * gateways built with the same profile keep their radio on but strobe their broadcasts, so sleeping nodes hear them.
+ * The profile is picked at build time, e.g. make node RDC_PROFILE=1, and has to be the same on all devices.
+ */
+
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+#define RDC_PROFILE_ALWAYS_ON 0 /**< Radio always on, NullRDC */
+#define RDC_PROFILE_CONTIKIMAC 1 /**< ContikiMAC checking the channel 8 times per second */
+#define RDC_PROFILE_CONTIKIMAC_FAST 2 /**< ContikiMAC checking the channel 16 times per second, halves the latency */
+
+#ifndef RDC_PROFILE
+#define RDC_PROFILE RDC_PROFILE_ALWAYS_ON /**< Radio duty cycling profile, one of RDC_PROFILE_* */
+#endif
+
+#undef NETSTACK_CONF_RDC
+#undef NETSTACK_CONF_RDC_CHANNEL_CHECK_RATE
+
+#if RDC_PROFILE == RDC_PROFILE_ALWAYS_ON
+#define NETSTACK_CONF_RDC nullrdc_driver
+#define RDC_PROFILE_NAME "always-on" /**< Name of the profile in the benchmark output */
+#else
+#define NETSTACK_CONF_RDC contikimac_driver
+#if RDC_PROFILE == RDC_PROFILE_CONTIKIMAC_FAST
+#define NETSTACK_CONF_RDC_CHANNEL_CHECK_RATE 16
+#define RDC_PROFILE_NAME "contikimac-16"
+#else
+#define NETSTACK_CONF_RDC_CHANNEL_CHECK_RATE 8
+#define RDC_PROFILE_NAME "contikimac-8"
+#endif
+/** ContikiMAC schedules its wake-ups on the only rtimer, so the firmware falls back to clock based timers */
+#define RDC_OWNS_RTIMER 1
+#endif
+
+#ifndef RDC_OWNS_RTIMER
+#define RDC_OWNS_RTIMER 0
+#endif
+
+#undef ENERGEST_CONF_ON
+#define ENERGEST_CONF_ON 1 /**< Energest measures the CPU and radio times for the energy summaries */
+
+#endif /* PROJECT_CONF_H_ */
@@ -0,0 +1,502 @@
+/**
+ * @file protocol.c
+ * @brief Encoding and decoding of the messages defined in protocol.h.
+ */
+
+#include "protocol.h"
+
+#include "sys/energest.h"
+
+#include <string.h> // For memcpy.
+
+/** @addtogroup protocol
+ * @{
+ */
+
+/** Node types in the order of their code on air */
+static const char node_types[] = {'N', 'S', 'G'};
+
+/**
+ * @brief Builds the header byte of a frame
+ * @param type Message type
+ * @return Header byte
+ */
+static uint8_t protocol_header(uint8_t type) {
+  return (PROTOCOL_VERSION << 4) | type;
+}
+
+/**
+ * @brief Packs two 12 bit values into three bytes
+ * @param buf Buffer of at least 3 bytes
+ * @param first First value, sent in the lower 12 bits
+ * @param second Second value, sent in the upper 12 bits
+ */
+static void pack12(uint8_t *buf, uint16_t first, uint16_t second) {
+  first &= 0x0FFF;
+  second &= 0x0FFF;
+  buf[0] = first & 0xFF;
+  buf[1] = (first >> 8) | ((second & 0x0F) << 4);
+  buf[2] = second >> 4;
+}
+
+/**
+ * @brief Unpacks two 12 bit values packed by pack12()
+ * @param buf Buffer of at least 3 bytes
+ * @param first First value
+ * @param second Second value
+ */
+static void unpack12(const uint8_t *buf, uint16_t *first, uint16_t *second) {
+  *first = buf[0] | ((buf[1] & 0x0F) << 8);
+  *second = (buf[1] >> 4) | (buf[2] << 4);
+}
+
+/**
+ * @brief Stores the lower 24 bits of a value little-endian
+ * @param buf Buffer of at least 3 bytes
+ * @param value Value to store
+ */
+static void put24(uint8_t *buf, uint32_t value) {
+  buf[0] = value & 0xFF;
+  buf[1] = (value >> 8) & 0xFF;
+  buf[2] = (value >> 16) & 0xFF;
+}
+
+/**
+ * @brief Reads a value stored by put24()
+ * @param buf Buffer of at least 3 bytes
+ * @return Value
+ */
+static uint32_t get24(const uint8_t *buf) {
+  return buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16);
+}
+
+/**
+ * @brief Maps a battery voltage to its code on air
+ * @param battery Battery voltage in mV
+ * @return Code of the battery voltage, voltages out of range are clamped
+ */
+static uint8_t battery_encode(uint16_t battery) {
+  // Clamp the battery voltage to the range that fits into one byte
+  if (battery < BATTERY_BASE_MV) {
+    battery = BATTERY_BASE_MV;
+  } else if (battery > BATTERY_BASE_MV + 255 * BATTERY_STEP_MV) {
+    battery = BATTERY_BASE_MV + 255 * BATTERY_STEP_MV;
+  }
+
+  return (battery - BATTERY_BASE_MV + BATTERY_STEP_MV / 2) / BATTERY_STEP_MV;
+}
+
+/**
+ * @brief Maps a signed value to an unsigned one, small magnitudes of either sign give small values
+ * @param value Signed value
+ * @return Zig-zag encoded value
+ */
+static uint16_t zigzag_encode(int16_t value) {
+  return ((uint16_t)value << 1) ^ (value < 0 ? 0xFFFF : 0);
+}
+
+/**
+ * @brief Reverses zigzag_encode()
+ * @param value Zig-zag encoded value
+ * @return Signed value
+ */
+static int16_t zigzag_decode(uint16_t value) {
+  return (int16_t)((value >> 1) ^ -(value & 1));
+}
+
+/**
+ * @brief Writes a value as varint, 7 bits per byte with the highest bit marking that another byte follows
+ * @param buf Buffer the value is written to
+ * @param space Free space in the buffer
+ * @param value Value to write
+ * @return Number of bytes written, 0 if the value did not fit
+ */
+static uint8_t varint_encode(uint8_t *buf, uint8_t space, uint16_t value) {
+  uint8_t len = 0;
+
+  do {
+    if (len >= space) {
+      return 0;
+    }
+    buf[len++] = (value & 0x7F) | (value > 0x7F ? 0x80 : 0);
+    value >>= 7;
+  } while (value > 0);
+
+  return len;
+}
+
+/**
+ * @brief Reads a value written by varint_encode()
+ * @param buf Buffer the value is read from
+ * @param len Number of bytes left in the buffer
+ * @param value Value read
+ * @return Number of bytes read, 0 if the buffer ended before the value
+ */
+static uint8_t varint_decode(const uint8_t *buf, uint8_t len, uint16_t *value) {
+  uint8_t i;
+
+  *value = 0;
+  for (i = 0; i < len && i < 3; i++) {
+    *value |= (uint16_t)(buf[i] & 0x7F) << (7 * i);
+    if (!(buf[i] & 0x80)) {
+      return i + 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Maps a node type to its code on air
+ * @param node_type Node type character
+ * @return Code of the node type, unknown types are sent as player nodes
+ */
+static uint8_t node_type_encode(char node_type) {
+  uint8_t i;
+  for (i = 0; i < sizeof(node_types); i++) {
+    if (node_types[i] == node_type) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Maps a code on air to its node type
+ * @param code Code of the node type
+ * @return Node type character
+ */
+static char node_type_decode(uint8_t code) {
+  return code < sizeof(node_types) ? node_types[code] : 'N';
+}
+
+uint16_t routing_frame_encode(uint8_t *buf, const struct routing_entry *entries, int count) {
+  struct routing_frame_wire *frame = (struct routing_frame_wire *)buf;
+  int i;
+
+  frame->header = protocol_header(MSG_TYPE_ROUTING);
+  for (i = 0; i < count && i < ROUTING_ENTRIES_PER_FRAME; i++) {
+    struct routing_entry_wire *wire = &frame->entries[i];
+    memcpy(wire->node_address, entries[i].node_address.u8, LINKADDR_SIZE);
+    memcpy(wire->next_hop, entries[i].next_hop.u8, LINKADDR_SIZE);
+    wire->hops = entries[i].hops;
+    wire->node_id = entries[i].node_id;
+    wire->seqno = entries[i].seqno;
+    wire->cost = entries[i].cost;
+    wire->flags = node_type_encode(entries[i].node_type) | (entries[i].still_active ? ROUTING_FLAG_ACTIVE : 0);
+  }
+
+  return 1 + i * sizeof(struct routing_entry_wire);
+}
+
+int routing_frame_decode(const uint8_t *buf, uint16_t len, struct routing_entry *entries, int max_entries) {
+  const struct routing_frame_wire *frame = (const struct routing_frame_wire *)buf;
+  int count;
+  int i;
+
+  if (len < 1 || frame->header != protocol_header(MSG_TYPE_ROUTING)) {
+    return 0;
+  }
+
+  count = (len - 1) / sizeof(struct routing_entry_wire);
+  if (count > max_entries) {
+    count = max_entries;
+  }
+
+  for (i = 0; i < count; i++) {
+    const struct routing_entry_wire *wire = &frame->entries[i];
+    memset(&entries[i], 0, sizeof(struct routing_entry));
+    memcpy(entries[i].node_address.u8, wire->node_address, LINKADDR_SIZE);
+    memcpy(entries[i].next_hop.u8, wire->next_hop, LINKADDR_SIZE);
+    entries[i].hops = wire->hops;
+    entries[i].node_id = wire->node_id;
+    entries[i].seqno = wire->seqno;
+    entries[i].cost = wire->cost;
+    entries[i].node_type = node_type_decode(wire->flags & ROUTING_FLAG_TYPE_MASK);
+    entries[i].still_active = (wire->flags & ROUTING_FLAG_ACTIVE) != 0;
+  }
+
+  return count;
+}
+
+uint16_t sensor_message_encode(uint8_t *buf, const struct sensor_message *message) {
+  struct sensor_message_wire *wire = (struct sensor_message_wire *)buf;
+  uint16_t interval = message->interval / INTERVAL_STEP_MS;
+  uint8_t path_len = message->path_len < MAX_PATH_HOPS ? message->path_len : MAX_PATH_HOPS;
+
+  uint16_t len;
+
+  wire->header = protocol_header(MSG_TYPE_SENSOR);
+  wire->flags = message->priority == PRIORITY_URGENT ? SENSOR_FLAG_URGENT : 0;
+  if (message->path_truncated) {
+    wire->flags |= SENSOR_FLAG_PATH_TRUNCATED;
+  }
+  wire->origin[0] = message->origin & 0xFF;
+  wire->origin[1] = message->origin >> 8;
+  wire->seqno = message->seqno;
+  wire->epoch = message->epoch;
+  wire->age[0] = message->age & 0xFF;
+  wire->age[1] = message->age >> 8;
+  pack12(wire->readings, message->force, message->oximeter);
+  pack12(wire->force_range, message->force_min, message->force_max);
+  pack12(wire->oximeter_range, message->oximeter_min, message->oximeter_max);
+  wire->battery = battery_encode(message->batteryLevel);
+  wire->interval = interval < 255 ? interval : 255;
+  wire->path_len = path_len;
+  memcpy(wire->path, message->path, path_len);
+
+#if PATH_WITH_RSSI
+  wire->flags |= SENSOR_FLAG_PATH_RSSI;
+  memcpy(wire->path + path_len, message->path_rssi, path_len);
+  len = SENSOR_MESSAGE_WIRE_FIXED_LEN + 2 * path_len;
+#else
+  len = SENSOR_MESSAGE_WIRE_FIXED_LEN + path_len;
+#endif
+
+  if (message->has_energy) {
+    wire->flags |= SENSOR_FLAG_ENERGY;
+    buf[len] = message->energy.node_id & 0xFF;
+    buf[len + 1] = message->energy.node_id >> 8;
+    put24(buf + len + 2, message->energy.cpu);
+    put24(buf + len + 5, message->energy.lpm);
+    put24(buf + len + 8, message->energy.transmit);
+    put24(buf + len + 11, message->energy.listen);
+    len += ENERGY_SUMMARY_WIRE_LEN;
+  }
+
+  if (message->batch_count > 0) {
+    uint16_t spacing = message->batch_spacing / INTERVAL_STEP_MS;
+    wire->flags |= SENSOR_FLAG_BATCH;
+    buf[len] = message->batch_count;
+    buf[len + 1] = spacing < 255 ? spacing : 255;
+    memcpy(buf + len + 2, message->batch, message->batch_len);
+    len += 2 + message->batch_len;
+  }
+
+  return len;
+}
+
+int sensor_message_decode(const uint8_t *buf, uint16_t len, struct sensor_message *message) {
+  const struct sensor_message_wire *wire = (const struct sensor_message_wire *)buf;
+  uint8_t with_rssi;
+  uint16_t path_end;
+  uint16_t batch_start;
+
+  if (len < SENSOR_MESSAGE_WIRE_FIXED_LEN || wire->header != protocol_header(MSG_TYPE_SENSOR)) {
+    return 0;
+  }
+
+  with_rssi = (wire->flags & SENSOR_FLAG_PATH_RSSI) != 0;
+  path_end = SENSOR_MESSAGE_WIRE_FIXED_LEN + (with_rssi ? 2 : 1) * wire->path_len;
+  if (wire->path_len > MAX_PATH_HOPS || len < path_end) {
+    return 0;
+  }
+  batch_start = path_end + ((wire->flags & SENSOR_FLAG_ENERGY) ? ENERGY_SUMMARY_WIRE_LEN : 0);
+  if (len < batch_start) {
+    return 0;
+  }
+  if ((wire->flags & SENSOR_FLAG_BATCH) && (len < batch_start + 2 || len - batch_start - 2 > BATCH_MAX_LEN)) {
+    return 0;
+  }
+
+  unpack12(wire->readings, &message->force, &message->oximeter);
+  unpack12(wire->force_range, &message->force_min, &message->force_max);
+  unpack12(wire->oximeter_range, &message->oximeter_min, &message->oximeter_max);
+  message->batteryLevel = BATTERY_BASE_MV + wire->battery * BATTERY_STEP_MV;
+  message->interval = wire->interval * INTERVAL_STEP_MS;
+  message->priority = (wire->flags & SENSOR_FLAG_URGENT) ? PRIORITY_URGENT : PRIORITY_NORMAL;
+  message->origin = wire->origin[0] | (wire->origin[1] << 8);
+  message->seqno = wire->seqno;
+  message->epoch = wire->epoch;
+  message->age = wire->age[0] | (wire->age[1] << 8);
+  message->path_truncated = (wire->flags & SENSOR_FLAG_PATH_TRUNCATED) != 0;
+  message->path_len = wire->path_len;
+  memcpy(message->path, wire->path, wire->path_len);
+  if (with_rssi) {
+    memcpy(message->path_rssi, wire->path + wire->path_len, wire->path_len);
+  } else {
+    memset(message->path_rssi, 0, sizeof(message->path_rssi));
+  }
+  message->has_energy = (wire->flags & SENSOR_FLAG_ENERGY) != 0;
+  if (message->has_energy) {
+    message->energy.node_id = buf[path_end] | (buf[path_end + 1] << 8);
+    message->energy.cpu = get24(buf + path_end + 2);
+    message->energy.lpm = get24(buf + path_end + 5);
+    message->energy.transmit = get24(buf + path_end + 8);
+    message->energy.listen = get24(buf + path_end + 11);
+  }
+  if (wire->flags & SENSOR_FLAG_BATCH) {
+    message->batch_count = buf[batch_start];
+    message->batch_spacing = buf[batch_start + 1] * INTERVAL_STEP_MS;
+    message->batch_len = len - batch_start - 2;
+    memcpy(message->batch, buf + batch_start + 2, message->batch_len);
+  } else {
+    message->batch_count = 0;
+    message->batch_spacing = 0;
+    message->batch_len = 0;
+  }
+
+  return 1;
+}
+
+uint16_t sensor_message_encoded_len(const struct sensor_message *message) {
+  uint8_t path_len = message->path_len < MAX_PATH_HOPS ? message->path_len : MAX_PATH_HOPS;
+
+  return SENSOR_MESSAGE_WIRE_FIXED_LEN + (PATH_WITH_RSSI ? 2 : 1) * path_len +
+         (message->has_energy ? ENERGY_SUMMARY_WIRE_LEN : 0) + (message->batch_count > 0 ? 2 + message->batch_len : 0);
+}
+
+uint16_t aggregate_begin(uint8_t *buf) {
+  buf[0] = protocol_header(MSG_TYPE_AGGREGATE);
+  buf[1] = 0;
+  return 2;
+}
+
+uint16_t aggregate_append(uint8_t *buf, uint16_t len, const struct sensor_message *message) {
+  uint16_t message_len = sensor_message_encoded_len(message);
+
+  if (len + 1 + message_len > AGGREGATE_MAX_LEN) {
+    return 0;
+  }
+
+  buf[len] = message_len;
+  sensor_message_encode(buf + len + 1, message);
+  buf[1]++;
+
+  return len + 1 + message_len;
+}
+
+int aggregate_decode(const uint8_t *buf, uint16_t len, struct sensor_message *messages, int max_messages) {
+  uint16_t offset = 2;
+  int count = 0;
+  int i;
+
+  if (len < 2 || buf[0] != protocol_header(MSG_TYPE_AGGREGATE)) {
+    return 0;
+  }
+
+  for (i = 0; i < buf[1] && count < max_messages; i++) {
+    uint8_t message_len;
+
+    if (offset >= len) {
+      break;
+    }
+    message_len = buf[offset];
+    if (offset + 1 + message_len > len) {
+      break;
+    }
+    if (sensor_message_decode(buf + offset + 1, message_len, &messages[count])) {
+      count++;
+    }
+    offset += 1 + message_len;
+  }
+
+  return count;
+}
+
+uint16_t device_id(const linkaddr_t *address) {
+  return (address->u8[LINKADDR_SIZE - 2] << 8) | address->u8[LINKADDR_SIZE - 1];
+}
+
+void sensor_message_append_hop(struct sensor_message *message, uint8_t node_id, int8_t rssi) {
+  if (message->path_len >= MAX_PATH_HOPS) {
+    message->path_truncated = 1;
+    return;
+  }
+
+  message->path[message->path_len] = node_id;
+  message->path_rssi[message->path_len] = rssi;
+  message->path_len++;
+}
+
+int sensor_batch_encode(struct sensor_message *message, const struct sensor_sample *samples, int count,
+                        uint16_t spacing) {
+  uint8_t len = 0;
+  int i;
+
+  message->force = samples[0].force;
+  message->oximeter = samples[0].oximeter;
+  message->batteryLevel = samples[0].batteryLevel;
+  message->batch_spacing = spacing;
+
+  for (i = 1; i < count && i < BATCH_MAX_SAMPLES; i++) {
+    uint8_t battery = battery_encode(samples[i].batteryLevel);
+    uint8_t battery_changed = battery != battery_encode(samples[i - 1].batteryLevel);
+    uint16_t force = zigzag_encode(samples[i].force - samples[i - 1].force) << 1 | battery_changed;
+    uint16_t oximeter = zigzag_encode(samples[i].oximeter - samples[i - 1].oximeter);
+    uint8_t force_len;
+    uint8_t oximeter_len;
+
+    force_len = varint_encode(message->batch + len, BATCH_MAX_LEN - len, force);
+    oximeter_len = force_len ? varint_encode(message->batch + len + force_len, BATCH_MAX_LEN - len - force_len,
+                                             oximeter) : 0;
+    if (oximeter_len == 0 || (battery_changed && len + force_len + oximeter_len >= BATCH_MAX_LEN)) {
+      break;
+    }
+    len += force_len + oximeter_len;
+    if (battery_changed) {
+      message->batch[len++] = battery;
+    }
+  }
+
+  message->batch_count = i - 1;
+  message->batch_len = len;
+  return i;
+}
+
+int sensor_batch_decode(const struct sensor_message *message, struct sensor_sample *samples, int max_samples) {
+  uint8_t offset = 0;
+  uint8_t battery = battery_encode(message->batteryLevel);
+  int count = 1;
+
+  samples[0].force = message->force;
+  samples[0].oximeter = message->oximeter;
+  samples[0].batteryLevel = message->batteryLevel;
+
+  while (count <= message->batch_count && count < max_samples) {
+    uint16_t force;
+    uint16_t oximeter;
+    uint8_t n;
+
+    n = varint_decode(message->batch + offset, message->batch_len - offset, &force);
+    if (n == 0) {
+      break;
+    }
+    offset += n;
+    n = varint_decode(message->batch + offset, message->batch_len - offset, &oximeter);
+    if (n == 0) {
+      break;
+    }
+    offset += n;
+    if (force & 1) {
+      if (offset >= message->batch_len) {
+        break;
+      }
+      battery = message->batch[offset++];
+    }
+
+    samples[count].force = (samples[count - 1].force + zigzag_decode(force >> 1)) & 0x0FFF;
+    samples[count].oximeter = (samples[count - 1].oximeter + zigzag_decode(oximeter)) & 0x0FFF;
+    samples[count].batteryLevel = BATTERY_BASE_MV + battery * BATTERY_STEP_MV;
+    count++;
+  }
+
+  return count;
+}
+
+void energy_summary_read(struct energy_summary *summary) {
+  energest_flush();
+  summary->node_id = device_id(&linkaddr_node_addr);
+  summary->cpu = (uint64_t)energest_type_time(ENERGEST_TYPE_CPU) * 1000 / RTIMER_SECOND;
+  summary->lpm = (uint64_t)energest_type_time(ENERGEST_TYPE_LPM) * 1000 / RTIMER_SECOND;
+  summary->transmit = (uint64_t)energest_type_time(ENERGEST_TYPE_TRANSMIT) * 1000 / RTIMER_SECOND;
+  summary->listen = (uint64_t)energest_type_time(ENERGEST_TYPE_LISTEN) * 1000 / RTIMER_SECOND;
+}
+
+void sensor_message_add_age(struct sensor_message *message, clock_time_t ticks) {
+  uint32_t age = message->age + (uint32_t)ticks * 1000 / CLOCK_SECOND;
+
+  message->age = age < SENSOR_AGE_MAX ? age : SENSOR_AGE_MAX;
+}
+
+/** @} */
@@ -0,0 +1,365 @@
+/**
+ * @file protocol.h
+ * @brief Messages exchanged between player nodes, switches and gateways and their encoding on air.
+ *
+ * Every frame starts with a one byte header holding the protocol version in the upper and the message type in the lower
+ * nibble. The wire structures only contain byte fields, so they have the same layout on every compiler and can be
+ * read straight from the packet buffer. Multi-byte values are sent little-endian.
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include "contiki.h"
+#include "core/net/linkaddr.h"
+
+// Standard C includes:
+#include <stdint.h>
+
+/**
+ * @defgroup protocol Protocol
+ * @brief Shared message definitions and wire format.
+ */
+
+/**@{*/
+
+#define PROTOCOL_VERSION 13 /**< Version of the wire format, frames of other versions are ignored */
+
+#define MSG_TYPE_ROUTING 1 /**< Frame carries routing entries */
+#define MSG_TYPE_SENSOR 2 /**< Frame carries a sensor message */
+#define MSG_TYPE_AGGREGATE 3 /**< Frame carries several sensor messages bundled by a switch */
+#define MSG_TYPE_STATS 4 /**< Record carries the forwarding statistics of a switch, only sent over serial */
+
+#define PRIORITY_NORMAL 0 /**< Priority class of routine sensor readings */
+#define PRIORITY_URGENT 1 /**< Priority class of alarm readings, always forwarded first */
+
+#define ROUTING_ENTRIES_PER_FRAME 11 /**< Maximum number of routing entries carried by one broadcast frame */
+
+#define ROUTING_FLAG_TYPE_MASK 0x03 /**< Bits of the flags byte holding the node type */
+#define ROUTING_FLAG_ACTIVE 0x04 /**< Bit of the flags byte holding the still active flag */
+#define SENSOR_FLAG_URGENT 0x01 /**< Bit of the flags byte marking an urgent reading */
+#define SENSOR_FLAG_PATH_TRUNCATED 0x02 /**< Bit of the flags byte marking a path that had more hops than MAX_PATH_HOPS */
+#define SENSOR_FLAG_PATH_RSSI 0x04 /**< Bit of the flags byte marking that the path carries the RSSI of every hop */
+#define SENSOR_FLAG_BATCH 0x08 /**< Bit of the flags byte marking a message that carries a batch of samples */
+#define SENSOR_FLAG_ENERGY 0x10 /**< Bit of the flags byte marking a message that carries an energy summary */
+
+#define SENSOR_AGE_MAX 0xFFFF /**< Age of a sensor message in ms that marks it as at least that old */
+
+#ifndef MAX_PATH_HOPS
+#define MAX_PATH_HOPS 8 /**< Maximum number of hops recorded in the path of a sensor message */
+#endif
+#ifndef PATH_WITH_RSSI
+#define PATH_WITH_RSSI 1 /**< Set to 1 to record the RSSI of every hop next to its node id */
+#endif
+
+#define COST_INFINITY 255 /**< Path cost of an unreachable node */
+
+#define BATTERY_BASE_MV 2000 /**< Battery voltage encoded as zero */
+#define BATTERY_STEP_MV 8 /**< Resolution of the encoded battery voltage */
+#define INTERVAL_STEP_MS 50 /**< Resolution of the encoded report interval */
+
+#define BATCH_MAX_SAMPLES 16 /**< Maximum number of samples in a batch, the first one included */
+#define BATCH_MAX_LEN 48 /**< Maximum length of the encoded samples that follow the first one */
+
+#define ENERGY_SUMMARY_WIRE_LEN 14 /**< Length of an energy summary on air, the device id and four 24 bit times */
+
+/** Structure to hold routing table entry */
+struct routing_entry {
+  linkaddr_t node_address; /**< Node address */
+  uint8_t hops; /**< Number of hops to the node */
+  linkaddr_t next_hop; /**< Next hop address */
+  uint8_t node_id; /**< Node ID */
+  char node_type; /**< Node type ('G' for gateway, 'S' for switch, 'N' for player node) */
+  uint8_t still_active; /**< Flag to indicate if entry is still active */
+  uint8_t changed; /**< Flag to indicate that the entry changed since the last advertisement, not sent on air */
+  uint8_t seqno; /**< Sequence number issued by the destination, odd numbers mark a broken route */
+  uint8_t cost; /**< Path cost to the node, the sum of the link costs along the route */
+  clock_time_t last_heard; /**< Time the route was last confirmed by an advertisement, not sent on air */
+};
+
+/**
+ * Energy summary of a player node, switch or gateway. The times are totals in ms since boot as measured by Energest,
+ * on air they wrap around every 4.6 hours. The host takes the difference between two summaries of the same node.
+ */
+struct energy_summary {
+  uint16_t node_id; /**< Device id of the device the summary belongs to, see device_id() */
+  uint32_t cpu; /**< Time the CPU was active */
+  uint32_t lpm; /**< Time the CPU spent in low power mode */
+  uint32_t transmit; /**< Time the radio was transmitting */
+  uint32_t listen; /**< Time the radio was listening */
+};
+
+/** One sample of a batch */
+struct sensor_sample {
+  uint16_t force; /**< Force value, 12 bit ADC reading */
+  uint16_t oximeter; /**< Oximeter value, 12 bit ADC reading */
+  uint16_t batteryLevel; /**< Battery voltage in mV */
+};
+
+/**
+ * Sensor Message Structure. A batch keeps its first sample in force, oximeter and batteryLevel, the age refers to that
+ * sample. The further samples stay encoded, switches forward them without looking at them.
+ */
+struct sensor_message {
+  uint16_t force; /**< Force value, 12 bit ADC reading averaged over the report */
+  uint16_t oximeter; /**< Oximeter value, 12 bit ADC reading averaged over the report */
+  uint16_t force_min; /**< Lowest smoothed force value since the previous report */
+  uint16_t force_max; /**< Peak smoothed force value since the previous report */
+  uint16_t oximeter_min; /**< Lowest smoothed oximeter value since the previous report */
+  uint16_t oximeter_max; /**< Peak smoothed oximeter value since the previous report */
+  uint16_t batteryLevel; /**< Battery voltage in mV */
+  uint8_t priority; /**< Priority class of the reading (PRIORITY_NORMAL or PRIORITY_URGENT) */
+  uint16_t origin; /**< Device id of the player node that took the reading, see device_id() */
+  uint8_t seqno; /**< Sequence number issued by the origin, together with origin and epoch it identifies the message */
+  uint8_t epoch; /**< Random number the origin picks at boot, tells a restarted origin from a late duplicate */
+  uint16_t age; /**< Time in ms since the reading was taken, every hop adds the time it held the message */
+  uint16_t interval; /**< Time in ms since the previous report of the origin, tells the host its current rate */
+  uint8_t path_len; /**< Number of hops recorded in the path */
+  uint8_t path_truncated; /**< Flag to indicate that hops were dropped because the path was full */
+  uint8_t path[MAX_PATH_HOPS]; /**< Node ids of the hops the packet passed, starting with the origin */
+  int8_t path_rssi[MAX_PATH_HOPS]; /**< RSSI each hop received the packet with, 0 for the origin */
+  uint8_t batch_count; /**< Number of samples following the first one, 0 for a single reading */
+  uint16_t batch_spacing; /**< Time in ms between two samples of the batch */
+  uint8_t batch_len; /**< Length of the encoded samples */
+  uint8_t batch[BATCH_MAX_LEN]; /**< Samples following the first one, see sensor_batch_encode() */
+  uint8_t has_energy; /**< Flag to indicate that energy holds the summary of the origin or a switch on the path */
+  struct energy_summary energy; /**< Energy summary piggybacked on the message */
+};
+
+/** Routing entry as it is sent on air, 9 bytes instead of 12 */
+struct routing_entry_wire {
+  uint8_t node_address[LINKADDR_SIZE]; /**< Node address */
+  uint8_t next_hop[LINKADDR_SIZE]; /**< Next hop address */
+  uint8_t hops; /**< Number of hops to the node */
+  uint8_t node_id; /**< Node ID */
+  uint8_t seqno; /**< Sequence number issued by the destination */
+  uint8_t cost; /**< Path cost to the node */
+  uint8_t flags; /**< Node type and still active flag, see ROUTING_FLAG_* */
+} __attribute__((packed));
+
+/** Routing frame as it is sent on air */
+struct routing_frame_wire {
+  uint8_t header; /**< Protocol version and message type */
+  struct routing_entry_wire entries[ROUTING_ENTRIES_PER_FRAME]; /**< Routing entries, the first one is the sender */
+} __attribute__((packed));
+
+/**
+ * Sensor message as it is sent on air. The fixed part is followed by path_len node ids and, if SENSOR_FLAG_PATH_RSSI
+ * is set, by path_len RSSI values. If SENSOR_FLAG_ENERGY is set, an energy summary of ENERGY_SUMMARY_WIRE_LEN bytes
+ * follows. If SENSOR_FLAG_BATCH is set, the number of further samples, their spacing in INTERVAL_STEP_MS and the encoded
+ * samples follow up to the end of the message.
+ */
+struct sensor_message_wire {
+  uint8_t header; /**< Protocol version and message type */
+  uint8_t flags; /**< Priority of the reading and path format, see SENSOR_FLAG_* */
+  uint8_t origin[2]; /**< Device id of the origin */
+  uint8_t seqno; /**< Sequence number issued by the origin */
+  uint8_t epoch; /**< Random number the origin picked at boot */
+  uint8_t age[2]; /**< Time in ms since the reading was taken */
+  uint8_t readings[3]; /**< Force and oximeter readings, 12 bits each */
+  uint8_t force_range[3]; /**< Lowest and peak force reading, 12 bits each */
+  uint8_t oximeter_range[3]; /**< Lowest and peak oximeter reading, 12 bits each */
+  uint8_t battery; /**< Battery voltage in BATTERY_STEP_MV above BATTERY_BASE_MV */
+  uint8_t interval; /**< Time since the previous report in INTERVAL_STEP_MS */
+  uint8_t path_len; /**< Number of hops recorded in the path */
+  uint8_t path[2 * MAX_PATH_HOPS]; /**< Node ids of the hops, followed by their RSSI values */
+} __attribute__((packed));
+
+#define SENSOR_MESSAGE_WIRE_FIXED_LEN 20 /**< Length of a sensor message on air without the path */
+/** Longest sensor message on air, a full path with RSSI values, an energy summary and a full batch */
+#define SENSOR_MESSAGE_MAX_LEN \
+  (SENSOR_MESSAGE_WIRE_FIXED_LEN + 2 * MAX_PATH_HOPS + ENERGY_SUMMARY_WIRE_LEN + 2 + BATCH_MAX_LEN)
+
+#ifndef AGGREGATE_MAX_LEN
+#define AGGREGATE_MAX_LEN 100 /**< Maximum length of an aggregated frame, leaves room for the MAC and Rime headers */
+#endif
+/** Maximum number of sensor messages in an aggregated frame, each one has a length byte and carries its origin hop */
+#define AGGREGATE_MAX_MESSAGES \
+  ((AGGREGATE_MAX_LEN - 2) / (1 + SENSOR_MESSAGE_WIRE_FIXED_LEN + (PATH_WITH_RSSI ? 2 : 1)))
+
+/** Counters of the forwarding statistics, in the order they appear in a statistics record */
+enum stats_counter {
+  STATS_RX_DATA_FRAMES, /**< Sensor frames received, plain or aggregated */
+  STATS_RX_DATA_MESSAGES, /**< Sensor messages received in those frames */
+  STATS_RX_CONTROL_FRAMES, /**< Routing frames received */
+  STATS_TX_DATA_FRAMES, /**< Sensor frames handed to the MAC layer, including retransmissions */
+  STATS_TX_CONTROL_FRAMES, /**< Routing frames sent */
+  STATS_FORWARDED, /**< Sensor messages acknowledged by the next hop */
+  STATS_DELIVERED, /**< Sensor messages printed by a gateway */
+  STATS_RETRANSMISSIONS, /**< Sensor messages scheduled for a retransmission */
+  STATS_DROP_MALFORMED, /**< Frames dropped because they could not be decoded */
+  STATS_DROP_DUPLICATE, /**< Sensor messages dropped as duplicates */
+  STATS_DROP_NO_ROUTE, /**< Sensor messages dropped because no gateway was reachable */
+  STATS_DROP_QUEUE_FULL_NORMAL, /**< Normal sensor messages dropped because no packet descriptor was free */
+  STATS_DROP_QUEUE_FULL_URGENT, /**< Urgent sensor messages dropped because no packet descriptor was free */
+  STATS_DROP_RETRIES, /**< Sensor messages dropped after their last retransmission failed */
+  STATS_RADIO_BUSY, /**< Transmissions deferred because the radio was busy */
+  STATS_COLLISIONS, /**< Frames lost to collisions or missing acknowledgements */
+  STATS_CONTROL_DEFERRED, /**< Routing frames deferred for lack of airtime budget */
+  STATS_DROP_LOG, /**< Serial output lines cut off because the log buffer was full */
+  STATS_NUM_COUNTERS /**< Number of counters */
+};
+
+#define STATS_MAX_NEIGHBORS 8 /**< Maximum number of neighbors in a statistics record */
+
+/** Statistics of one neighbor as they are sent in a statistics record */
+struct stats_neighbor_wire {
+  uint8_t address[LINKADDR_SIZE]; /**< Address of the neighbor */
+  uint8_t delivered[2]; /**< Packets delivered to the neighbor */
+  uint8_t retransmissions[2]; /**< Retransmissions to the neighbor */
+  uint8_t lost[2]; /**< Packets dropped after the last retransmission to the neighbor failed */
+  uint8_t etx; /**< Transmissions per delivered packet in 1/8 */
+  uint8_t rssi; /**< Average RSSI of the neighbor in dBm, two's complement */
+} __attribute__((packed));
+
+/**
+ * Statistics record of a switch. It is printed over serial as a line starting with "STATS " followed by the record in
+ * hex, and only carries num_neighbors neighbor entries. Counters are totals since boot and wrap around at 65535.
+ */
+struct stats_record_wire {
+  uint8_t header; /**< Protocol version and message type */
+  uint8_t node_id; /**< Node ID of the switch */
+  uint8_t uptime[4]; /**< Seconds since boot */
+  uint8_t counters[2 * STATS_NUM_COUNTERS]; /**< Counters in the order of enum stats_counter */
+  uint8_t queue_high_water[2]; /**< Most packets queued at once, normal and urgent queue */
+  uint8_t pool_high_water; /**< Most packet descriptors in use at once */
+  uint8_t pool_size; /**< Number of packet descriptors */
+  uint8_t num_neighbors; /**< Number of neighbor entries */
+  struct stats_neighbor_wire neighbors[STATS_MAX_NEIGHBORS]; /**< Neighbors packets were forwarded to */
+} __attribute__((packed));
+
+/**
+ * @brief Encodes routing entries into a routing frame
+ * @param buf Buffer of at least sizeof(struct routing_frame_wire) bytes
+ * @param entries Entries to encode, the first one has to be the entry of the sender
+ * @param count Number of entries, at most ROUTING_ENTRIES_PER_FRAME
+ * @return Length of the frame in bytes
+ */
+uint16_t routing_frame_encode(uint8_t *buf, const struct routing_entry *entries, int count);
+
+/**
+ * @brief Decodes a routing frame
+ * @param buf Received frame
+ * @param len Length of the received frame
+ * @param entries Array the entries are decoded into
+ * @param max_entries Size of the array
+ * @return Number of decoded entries, 0 if the frame is not a routing frame of this protocol version
+ */
+int routing_frame_decode(const uint8_t *buf, uint16_t len, struct routing_entry *entries, int max_entries);
+
+/**
+ * @brief Encodes a sensor message
+ * @param buf Buffer of at least SENSOR_MESSAGE_MAX_LEN bytes
+ * @param message Message to encode
+ * @return Length of the encoded message in bytes
+ */
+uint16_t sensor_message_encode(uint8_t *buf, const struct sensor_message *message);
+
+/**
+ * @brief Decodes a sensor message
+ * @param buf Received frame
+ * @param len Length of the received frame
+ * @param message Structure the message is decoded into
+ * @return 1 if the message was decoded, 0 if the frame is not a sensor message of this protocol version
+ */
+int sensor_message_decode(const uint8_t *buf, uint16_t len, struct sensor_message *message);
+
+/**
+ * @brief Gets the length of a sensor message on air
+ * @param message Message
+ * @return Length sensor_message_encode() will return for the message
+ */
+uint16_t sensor_message_encoded_len(const struct sensor_message *message);
+
+/**
+ * @brief Starts an aggregated frame
+ * @param buf Buffer of at least AGGREGATE_MAX_LEN bytes
+ * @return Length of the empty frame
+ *
+ * An aggregated frame consists of the header byte, the number of bundled messages and every message prefixed with its
+ * length.
+ */
+uint16_t aggregate_begin(uint8_t *buf);
+
+/**
+ * @brief Appends a sensor message to an aggregated frame
+ * @param buf Frame started with aggregate_begin()
+ * @param len Current length of the frame
+ * @param message Message to append
+ * @return New length of the frame, 0 if the message does not fit into AGGREGATE_MAX_LEN
+ */
+uint16_t aggregate_append(uint8_t *buf, uint16_t len, const struct sensor_message *message);
+
+/**
+ * @brief Decodes an aggregated frame
+ * @param buf Received frame
+ * @param len Length of the received frame
+ * @param messages Array the messages are decoded into
+ * @param max_messages Size of the array
+ * @return Number of decoded messages, 0 if the frame is not an aggregated frame of this protocol version
+ */
+int aggregate_decode(const uint8_t *buf, uint16_t len, struct sensor_message *messages, int max_messages);
+
+/**
+ * @brief Gets the id of a device that is unique in the network
+ * @param address Link-layer address of the device
+ * @return The last two bytes of the address
+ *
+ * The one byte node ids of the path and the routing table repeat among a large squad, this id identifies the origin
+ * of a sensor message and the device of an energy summary.
+ */
+uint16_t device_id(const linkaddr_t *address);
+
+/**
+ * @brief Appends a hop to the path of a sensor message
+ * @param message Message the hop is appended to
+ * @param node_id Node id of the hop
+ * @param rssi RSSI the hop received the message with, 0 for the origin
+ *
+ * If the path is already full the hop is not recorded and the path is marked as truncated.
+ */
+void sensor_message_append_hop(struct sensor_message *message, uint8_t node_id, int8_t rssi);
+
+/**
+ * @brief Encodes a batch of samples into a sensor message
+ * @param message Message the samples are stored in
+ * @param samples Samples, oldest first
+ * @param count Number of samples
+ * @param spacing Time in ms between two samples
+ * @return Number of samples stored, the ones that did not fit into BATCH_MAX_LEN are left out
+ *
+ * The first sample is stored in the reading fields of the message. Every further one is sent as the zig-zag varint of
+ * its force delta, shifted left by one with the lowest bit marking a battery change, and the zig-zag varint of its
+ * oximeter delta. Only if the battery reading changed, its encoded value follows as one byte.
+ */
+int sensor_batch_encode(struct sensor_message *message, const struct sensor_sample *samples, int count,
+                        uint16_t spacing);
+
+/**
+ * @brief Expands the samples of a sensor message
+ * @param message Received message, a single reading or a batch
+ * @param samples Array the samples are decoded into, oldest first
+ * @param max_samples Size of the array
+ * @return Number of samples decoded, at least 1
+ */
+int sensor_batch_decode(const struct sensor_message *message, struct sensor_sample *samples, int max_samples);
+
+/**
+ * @brief Reads the Energest counters of this device into an energy summary
+ * @param summary Summary to fill, stamped with the device id of the own link-layer address
+ */
+void energy_summary_read(struct energy_summary *summary);
+
+/**
+ * @brief Adds the time a hop held a sensor message to its age
+ * @param message Message that was held
+ * @param ticks Time the message was held in clock ticks
+ *
+ * The nodes do not share a clock, so instead of the origin time every message carries its age. The age saturates at
+ * SENSOR_AGE_MAX.
+ */
+void sensor_message_add_age(struct sensor_message *message, clock_time_t ticks);
+
+/**@}*/
+
+#endif /* PROTOCOL_H */
@@ -9,8 +9,14 @@
 #include "net/netstack.h"  // Wireless-stack definitions
 #include "dev/leds.h"	   // Use LEDs.
 #include "core/net/linkaddr.h"
+#include "lib/random.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+#include "dev/serial-line.h"
+#include "protocol.h"      // Shared messages and wire format
+#include "log.h"           // Log levels and buffered serial output
 // Standard C includes:
-#include <stdio.h> // For printf.
+#include <string.h> // For memmove and memcpy.
 
 
 /**
@@ -24,53 +30,121 @@
 /**@{*/
 
 // Creates an instance of a broadcast connection.
-#define MAX_NODES 5 /**< Maximum number of nodes expected in the network, used to define table size */
+#ifndef MAX_NODES
+#define MAX_NODES 64 /**< Maximum number of entries in the routing table, see routing_table_insert() for the eviction policy */
+#endif
+#define ADVERTISEMENT_INTERVAL (CLOCK_SECOND * 5) /**< Interval of the periodic routing advertisements */
+#define ADVERTISEMENT_JITTER (CLOCK_SECOND / 2) /**< Random jitter applied to every periodic advertisement */
+#define FULL_DUMP_INTERVAL 6 /**< Every n-th periodic advertisement carries the full routing table */
+#define TRIGGERED_UPDATE_DELAY (CLOCK_SECOND / 8) /**< Minimum delay of a triggered update, a random jitter of the same size is added */
+#define CHANNEL_CAPACITY 31250 /**< Capacity of the 250 kbit/s 802.15.4 channel in bytes per second */
+#ifndef CONTROL_AIRTIME_PERCENT
+#define CONTROL_AIRTIME_PERCENT 3 /**< Share of the channel capacity that routing advertisements may use */
+#endif
+#define CONTROL_BUDGET (CHANNEL_CAPACITY * CONTROL_AIRTIME_PERCENT / 100) /**< Airtime budget of routing advertisements in bytes per second */
+#define CONTROL_FRAME_OVERHEAD 21 /**< Bytes a broadcast frame spends on air besides its payload (PHY, MAC and Rime headers) */
+#define CONTROL_STATS_INTERVAL (CLOCK_SECOND * 10) /**< Interval of the control plane overhead report */
+#define TABLE_REPORT_INTERVAL CLOCK_SECOND /**< Shortest interval between two routing table reports for the GUI */
+#define REPORT_LINE_MAX 320 /**< Longest line the report process prints, a sensor sample with a full path */
+#if LOG_BUFFER_SIZE - 2 < REPORT_LINE_MAX
+#error "LOG_BUFFER_SIZE has to hold the longest line of the report process"
+#endif
+#ifndef ENERGY_REPORT_INTERVAL
+#define ENERGY_REPORT_INTERVAL (CLOCK_SECOND * 30) /**< Interval of the energy summaries, piggybacked on forwarded messages */
+#endif
+#ifndef ROUTE_LIFETIME
+#define ROUTE_LIFETIME (ADVERTISEMENT_INTERVAL + ADVERTISEMENT_JITTER + CLOCK_SECOND / 4) /**< Time a route stays valid without being confirmed, one advertisement interval plus its worst case jitter */
+#endif
 #define INFINITY_HOPS 255 /**< Value to represent infinity hops */
-#define MAX_QUEUE_SIZE 10 /**< Maximum number of packets that the queue can hold */
+// A descriptor holds a whole struct sensor_message, batch and energy summary included, about 140 bytes on the CC2538
+#ifndef PACKET_POOL_SIZE
+#define PACKET_POOL_SIZE 16 /**< Number of packet descriptors shared by the forwarding queues, about 2.2 KB */
+#endif
+#define URGENT_RESERVE 4 /**< Packet descriptors only urgent packets may take, so normal traffic cannot crowd them out */
+#define NUM_PRIORITIES 2 /**< Number of priority classes, one forwarding queue each */
+#ifndef AGGREGATION_MAX_HOLD
+#define AGGREGATION_MAX_HOLD (CLOCK_SECOND / 32) /**< Longest time a normal packet is held back to be bundled with others */
+#endif
+#define BACKOFF_CW_MIN (RTIMER_SECOND / 512) /**< Smallest contention window of the transmit scheduler, about 2 ms */
+#define BACKOFF_CW_MAX (RTIMER_SECOND / 16) /**< Largest contention window of the transmit scheduler, about 60 ms */
+#ifndef FORWARD_MAX_RETRIES
+#define FORWARD_MAX_RETRIES 3 /**< Retransmissions of a forwarded packet before it is dropped, 0 sends every packet once */
+#endif
+#define FORWARD_BACKOFF (CLOCK_SECOND / 16) /**< Backoff after the first failed transmission, doubled with every further failure */
+#define FORWARD_SENT_TIMEOUT (CLOCK_SECOND / 2) /**< Time after which a frame the MAC layer did not report on counts as failed */
+#ifndef MAX_NEIGHBORS
+#define MAX_NEIGHBORS 16 /**< Maximum number of neighbors a link estimate is kept for */
+#endif
+#define LINK_COST_UNIT 8 /**< Cost of a perfect link, one transmission per delivered packet and a strong signal */
+#define LINK_ETX_FAILED (LINK_COST_UNIT * 8) /**< ETX sample recorded for a unicast that was never acknowledged */
+#define LINK_ETX_SHIFT 2 /**< A new ETX sample is weighted 1/4 against the current estimate */
+#define LINK_RSSI_SHIFT 3 /**< A new RSSI sample is weighted 1/8 against the current estimate */
+#define LINK_RSSI_GOOD (-80) /**< RSSI in dBm above which the signal strength does not add to the link cost */
+#define LINK_RSSI_PENALTY_MAX (LINK_COST_UNIT * 2) /**< Maximum cost added for a weak signal, reached 32 dB below LINK_RSSI_GOOD */
+#ifndef DEDUP_CACHE_SIZE
+#define DEDUP_CACHE_SIZE 16 /**< Number of origins the duplicate suppression cache keeps track of */
+#endif
+#define DEDUP_WINDOW 32 /**< Number of sequence numbers below the newest one that are remembered per origin */
+#define ROUTE_COST_HYSTERESIS (LINK_COST_UNIT / 2) /**< Cost a route has to save to replace a route with the same sequence number */
 
 // MAC LAYER PARAMETERS
+// The radio duty cycling profile is selected in project-conf.h, switches and gateways always keep their radio on
 
-/**
- * @def NETSTACK_CONF_RDC
- * @brief Definition for NullRDC driver.
- */
-#define NETSTACK_CONF_RDC nullrdc_driver
+/** Unicast packet structure, a descriptor from packet_pool linked into one of the forwarding queues */
+struct unicast_packet {
+  struct unicast_packet *next; /**< Next packet in the queue, has to be the first member for the list library */
+  linkaddr_t destination; /**< Destination address */
+  struct sensor_message data; /**< Sensor data */
+  uint8_t length; /**< Length of the packet on air */
+  clock_time_t queued_at; /**< Time the packet was queued */
+  uint8_t retries; /**< Number of failed transmissions of the packet */
+  uint8_t in_flight; /**< Flag to indicate that the packet is part of the frame the MAC layer is sending */
+  clock_time_t last_attempt; /**< Time of the last failed transmission */
+  clock_time_t backoff; /**< Time to wait after the last failed transmission before the packet is sent again */
+};
 
-/** Structure to hold routing table entry */
-struct routing_entry {
-  linkaddr_t node_address; /**< Node address */
-  uint8_t hops; /**< Number of hops to the node */
-  linkaddr_t next_hop; /**< Next hop address */
-  int8_t node_id; /**< Node ID */
-  char node_type; /**< Node type */
-  uint8_t still_active; /**< Flag to indicate if entry is still active */
+/** States of the backoff before a frame is sent */
+enum {
+  BACKOFF_IDLE, /**< No backoff is running */
+  BACKOFF_RUNNING, /**< The backoff timer is running */
+  BACKOFF_DONE /**< The backoff ended and the frame may be sent if the channel is free */
 };
 
-/** Sensor Message Structure */
-struct sensor_message {
-    int16_t force; /**< Force value */
-    int16_t oximeter; /**< Oximeter value */  
-    int32_t path; /**< Path of the packet as it reaches the gateway */
-	int16_t batteryLevel;  /**< Battery Voltage value */
+/** Link estimate of a neighbor */
+struct link_estimate {
+  linkaddr_t address; /**< Address of the neighbor */
+  int16_t rssi; /**< Moving average of the RSSI the neighbor is received with, in 1/8 dBm */
+  uint8_t etx; /**< Moving average of the transmissions needed per delivered unicast, in LINK_COST_UNIT */
+  clock_time_t last_heard; /**< Time the neighbor was last heard or sent to */
+  uint16_t delivered; /**< Number of packets delivered to the neighbor */
+  uint16_t retransmissions; /**< Number of retransmissions to the neighbor */
+  uint16_t lost; /**< Number of packets dropped after FORWARD_MAX_RETRIES retransmissions to the neighbor */
 };
 
-/** Unicast packet structure */
-struct unicast_packet {
-  linkaddr_t destination; /**< Destination address */
-  struct sensor_message data; /**< Sensor data */
-  uint8_t length; /**< Length of the packet */
+/** Sequence numbers recently seen from one origin */
+struct dedup_entry {
+  uint16_t origin; /**< Device id of the origin */
+  uint8_t epoch; /**< Boot epoch of the origin the sequence numbers belong to */
+  uint8_t newest; /**< Newest sequence number seen */
+  uint32_t window; /**< Bit n is set if sequence number newest - n was seen */
+  clock_time_t last_used; /**< Time the entry was last used, the least recently used entry is replaced */
+};
+
+/** Unicast packet queue, a list of packet descriptors */
+struct unicast_queue {
+  LIST_STRUCT(packets); /**< Queued packets, oldest first */
+  int size; /**< Current size of the queue */
 };
 
-struct unicast_packet unicast_queue[MAX_QUEUE_SIZE]; /**< Unicast packet queue */
-int queue_size = 0;  /**< Current size of the queue */
+struct unicast_queue unicast_queues[NUM_PRIORITIES]; /**< One forwarding queue per priority class */
+MEMB(packet_pool, struct unicast_packet, PACKET_POOL_SIZE); /**< Packet descriptors of the forwarding queues */
 
 
-struct routing_entry routing_table[MAX_NODES]; /**< Routing table */
-int num_nodes = 0; /**< Number of nodes found in the network */
-int last_entry = -1; /**< Index of the last non-zero entry in the routing table */
+struct routing_entry routing_table[MAX_NODES]; /**< Routing table, kept sorted by node address */
+int num_nodes = 0; /**< Number of entries in the routing table */
 static char self_node_type = 'G'; /**< Storing the Node type */
-int32_t node_number = 7; /**< Node number used to set current Node id in the path.*/
-int8_t node_number2=7; /**< Node number used to set current node id in the routing table. */
+uint8_t node_number; /**< Node number used to set current Node id in the path, set from the link-layer address */
+uint8_t node_number2; /**< Node number used to set current node id in the routing table, the same as node_number */
 
 /** Routing Process to hanlde network discovery*/
 PROCESS(routing_process, "Routing Process");
@@ -78,33 +152,184 @@ PROCESS(routing_process, "Routing Process");
 PROCESS(timeout_process, "Timeout Process");
 /** Unicast Forward Process which handles forwarding the packets in the queue */
 PROCESS(unicast_forward_process, "Unicast Forward Process");
+/** Report Process which prints the delivered sensor messages and the routing table for the GUI */
+PROCESS(report_process, "Report Process");
 /** Autostart processes */
 AUTOSTART_PROCESSES(
   &routing_process,
   &timeout_process,
-  &unicast_forward_process
+  &unicast_forward_process,
+  &report_process,
+  &log_process
 );
 
 static struct broadcast_conn broadcast; /**< Declare the broadcast connection */
 static struct unicast_conn unicast; /**< Declare the unicast connection */
 static struct etimer timeout_timer; /**< Timer for handling timeout of entries */
+static uint16_t log_dropped_reported = 0; /**< Number of dropped log lines at the last control plane report */
+static uint8_t routing_table_updated = 0; /**< Flag to indicate that a routing frame was received since the last table report */
+LIST(report_queue); /**< Sensor messages a gateway delivered and the report process has yet to print, oldest first */
+static process_event_t packet_queued_event; /**< Event posted to the forward process whenever a packet is queued */
+static uint8_t bundle[AGGREGATE_MAX_LEN]; /**< Frame the forward process bundles queued packets into */
+static uint8_t frame_in_flight = 0; /**< Flag to indicate that the MAC layer is sending a bundle and has not reported back */
+static linkaddr_t frame_destination; /**< Next hop of the bundle in flight */
+#if RDC_OWNS_RTIMER
+static struct ctimer backoff_timer; /**< Timer ending the random backoff, ContikiMAC owns the rtimer */
+#else
+static struct rtimer backoff_timer; /**< Timer ending the random backoff before the next frame */
+#endif
+static volatile uint8_t backoff_state = 0; /**< State of the backoff before the next frame, see BACKOFF_IDLE */
+static rtimer_clock_t contention_window = BACKOFF_CW_MIN; /**< Current contention window in rtimer ticks */
+static struct ctimer triggered_update_timer; /**< Timer for sending a triggered routing update */
+static uint8_t full_dump_requested = 0; /**< Flag to indicate that the next advertisement should carry the full table */
+static int32_t control_budget = CONTROL_BUDGET; /**< Airtime left for control frames in bytes */
+static clock_time_t control_budget_updated = 0; /**< Time the control budget was last refilled */
+static uint16_t control_packets_sent = 0; /**< Control frames sent in the current statistics interval */
+static uint16_t control_packets_received = 0; /**< Control frames received in the current statistics interval */
+static uint16_t control_packets_deferred = 0; /**< Control frames deferred for lack of budget in the current statistics interval */
+static uint32_t control_bytes_sent = 0; /**< Control bytes put on air in the current statistics interval */
+static uint8_t gateway_turn = 0; /**< Round robin counter to spread traffic across gateways with the same cost */
+static struct link_estimate links[MAX_NEIGHBORS]; /**< Link estimates of the neighbors */
+static uint8_t num_links = 0; /**< Number of neighbors in links */
+static struct dedup_entry dedup_cache[DEDUP_CACHE_SIZE]; /**< Duplicate suppression cache */
+static uint8_t dedup_cache_size = 0; /**< Number of origins in dedup_cache */
+static uint16_t stats[STATS_NUM_COUNTERS]; /**< Forwarding statistics, indexed by enum stats_counter */
+static struct timer energy_timer; /**< Timer for the next energy summary */
+static uint8_t queue_high_water[NUM_PRIORITIES]; /**< Most packets queued at once per priority class */
+static uint8_t pool_high_water = 0; /**< Most packet descriptors in use at once */
+static struct stats_record_wire stats_record; /**< Statistics record being printed */
 
 /**
  * @brief Function to broadcast routing table information
+ * @param full_dump 1 to advertise the full table, 0 to advertise only the entries that changed
+ */
+static void broadcast_routing_table(int full_dump);
+
+/**
+ * @brief Function to send the routing table as one or more broadcast frames
+ * @param full_dump 1 to send all entries, 0 to send only the entries that changed
+ */
+static void send_routing_frames(int full_dump);
+
+/**
+ * @brief Function to schedule a triggered routing update
+ * @param full_dump 1 if the update should carry the full table
+ */
+static void schedule_triggered_update(int full_dump);
+
+/**
+ * @brief Function to broadcast one routing frame if the control plane airtime budget allows it
+ * @param frame Routing entries to send
+ * @param count Number of entries in the frame
+ * @return 1 if the frame was sent, 0 if it has to be deferred
+ */
+static int send_control_frame(const struct routing_entry *frame, int count);
+
+/**
+ * @brief Function to print the control plane overhead and reset the counters
+ */
+static void report_control_stats();
+
+/**
+ * @brief Function to print the delivery statistics of every neighbor packets were forwarded to
+ */
+static void report_forward_stats();
+
+/**
+ * @brief Function to print the forwarding statistics as one binary record
+ */
+static void report_stats_record();
+
+/**
+ * @brief Function to print an energy summary in JSON format for the GUI
+ * @param energy Energy summary
  */
-static void broadcast_routing_table();
+static void print_energy_summary(const struct energy_summary *energy);
+
+/**
+ * @brief Function to print a routing table entry in JSON format for the GUI
+ * @param index Position of the entry in the routing table
+ */
+static void print_routing_entry(int index);
+
+/**
+ * @brief Function to look up a node in the routing table
+ * @param addr Address of the node
+ * @param position If not NULL, set to the index the node is at or would have to be inserted at
+ * @return Index of the entry, or -1 if the node is not in the table
+ */
+static int routing_table_find(const linkaddr_t *addr, int *position);
+
+/**
+ * @brief Function to add a node to the routing table, evicting another entry if the table is full
+ * @param addr Address of the node
+ * @param hops Number of hops to the node
+ * @return The new entry, or NULL if the table is full and no entry is worse than the new one
+ */
+static struct routing_entry *routing_table_insert(const linkaddr_t *addr, uint8_t hops);
+
+/**
+ * @brief Function to pick the gateway route sensor messages are forwarded along
+ * @return Entry of the chosen gateway, or NULL if no live route to a gateway is known
+ */
+static struct routing_entry *select_gateway();
+
+/**
+ * @brief Function to look up the link estimate of a neighbor
+ * @param addr Address of the neighbor
+ * @return Link estimate of the neighbor, or NULL if there is none yet
+ */
+static struct link_estimate *link_estimate_find(const linkaddr_t *addr);
+
+/**
+ * @brief Function to add a link estimate for a new neighbor
+ * @param addr Address of the neighbor
+ * @param rssi RSSI the neighbor was first heard with in dBm
+ * @return Link estimate of the neighbor
+ */
+static struct link_estimate *link_estimate_add(const linkaddr_t *addr, int16_t rssi);
+
+/**
+ * @brief Function to feed the RSSI of a received frame into the link estimate of its sender
+ * @param addr Address of the sender
+ * @param rssi RSSI of the frame in dBm
+ */
+static void link_estimate_rssi(const linkaddr_t *addr, int16_t rssi);
+
+/**
+ * @brief Function to get the cost of the link to a neighbor
+ * @param addr Address of the neighbor
+ * @return Link cost in LINK_COST_UNIT per perfect link
+ */
+static uint8_t link_cost(const linkaddr_t *addr);
+
+/**
+ * @brief Function called by the MAC layer once a unicast was sent, feeds the outcome into the link estimate
+ * @param c Unicast connection
+ * @param status MAC_TX_OK if the frame was acknowledged
+ * @param num_tx Number of transmissions
+ */
+static void sent_unicast(struct unicast_conn *c, int status, int num_tx);
 
 /**
  * @brief Function to update routing table. It goes through the recieved routing table and checks if there are entries which are valid and puts them into the current routing rable
  * @param received_table Received routing table
+ * @param num_received Number of entries in the received table
  * @param sender_addr Sender's address
  */
-static void update_routing_table(const struct routing_entry *received_table, const linkaddr_t *sender_addr);
+static void update_routing_table(const struct routing_entry *received_table, int num_received, const linkaddr_t *sender_addr);
+
+/**
+ * @brief Function to mark a route as broken
+ * @param entry Routing entry
+ */
+static void break_route(struct routing_entry *entry);
 
 /**
  * @brief Function to handle timeout of entries to mark old entries as expired
+ * @return Time until the next entry expires, 0 if no entry can expire
  */
-static void handle_timeout();
+static clock_time_t handle_timeout();
 
 /**
  * @brief Function to receive broadcast packets
@@ -121,6 +346,116 @@ static void recv_broadcast(struct broadcast_conn *c, const linkaddr_t *from);
  */
 static void recv_unicast(struct unicast_conn *c, const linkaddr_t *from);
 
+/**
+ * @brief Function to print a sample of a sensor message in JSON format for the GUI
+ * @param data Sensor message
+ * @param sample Number of the sample, 0 for the first one
+ */
+static void print_sensor_message(const struct sensor_message *data, int sample);
+
+/**
+ * @brief Function to queue a sensor message a gateway delivered for the report process
+ * @param data Sensor message
+ * @return 1 if the message was queued, 0 if no packet descriptor was free
+ */
+static int report_sensor_message(const struct sensor_message *data);
+
+/**
+ * @brief Function to add a sensor message to the forwarding queue of its priority class
+ * @param data Sensor message
+ * @return 1 if the message was queued, 0 if there is no route to a gateway or no packet descriptor is free
+ */
+static int enqueue_sensor_message(const struct sensor_message *data);
+
+/**
+ * @brief Function to check whether a sensor message was seen before and remember it otherwise
+ * @param data Sensor message
+ * @return 1 if the message is a duplicate, 0 otherwise
+ */
+static int dedup_check(const struct sensor_message *data);
+
+/**
+ * @brief Function to get how long the forward process should wait before sending the next bundle
+ * @param next Packet that would be sent next
+ * @return 0 to send right away, otherwise the remaining hold time
+ */
+static clock_time_t bundle_hold_time(const struct unicast_packet *next);
+
+/**
+ * @brief Function to bundle the ready packets that go to the same next hop
+ * @param destination Next hop of the bundle
+ * @return Length of the frame in bundle
+ */
+static uint16_t build_bundle(const linkaddr_t *destination);
+
+/**
+ * @brief Function to take a packet descriptor from the pool
+ * @param priority Priority class of the packet
+ * @return Packet descriptor, or NULL if no descriptor is free for the priority class
+ */
+static struct unicast_packet *packet_alloc(uint8_t priority);
+
+/**
+ * @brief Function to append a packet at the tail of a forwarding queue
+ * @param queue Queue to append to
+ * @param packet Packet descriptor taken with packet_alloc()
+ */
+static void queue_push(struct unicast_queue *queue, struct unicast_packet *packet);
+
+/**
+ * @brief Function to remove a packet from a forwarding queue and return its descriptor to the pool
+ * @param queue Queue to remove from
+ * @param packet Packet to remove
+ */
+static void queue_remove(struct unicast_queue *queue, struct unicast_packet *packet);
+
+/**
+ * @brief Function to check whether a queued packet may be sent now
+ * @param packet Queued packet
+ * @param now Current time
+ * @return 1 if the packet is neither in flight nor backing off, 0 otherwise
+ */
+static int packet_ready(const struct unicast_packet *packet, clock_time_t now);
+
+/**
+ * @brief Function to select the packet that should be sent next
+ * @param wait Set to the time until the next backoff ends if no packet is ready, 0 if nothing is backing off
+ * @return The oldest ready packet of the highest priority queue, or NULL if no packet is ready
+ */
+static struct unicast_packet *queue_next(clock_time_t *wait);
+
+/**
+ * @brief Function to settle the packets of the frame the MAC layer reported on
+ * @param delivered 1 if the frame was acknowledged, 0 otherwise
+ */
+static void forward_complete(int delivered);
+
+/**
+ * @brief Function to start a random backoff within the contention window
+ */
+static void backoff_start();
+
+/**
+ * @brief Function called by the rtimer when the backoff ends
+ * @param t Backoff timer
+ * @param ptr Unused
+ */
+static void backoff_expired(struct rtimer *t, void *ptr);
+
+#if RDC_OWNS_RTIMER
+/**
+ * @brief Function called by the ctimer when the backoff ends
+ * @param ptr Unused
+ */
+static void backoff_expired_callback(void *ptr);
+#endif
+
+/**
+ * @brief Function to adapt the contention window to the contention observed
+ * @param congested 1 if the channel was busy or a frame was lost, 0 if a frame went through
+ */
+static void contention_window_update(int congested);
+
 /**
  * @brief Initializes the switch gateway functionality.
  *
@@ -145,317 +480,1652 @@ void switch_gateway_start();
 /*---------------------------------------------------------------------------*/
 /**
  * @brief Function to broadcast routing table information
+ * @param full_dump 1 to advertise the full table, 0 to advertise only the entries that changed
  *
- * This function broadcasts the routing table information to neighboring nodes.
+ * This function broadcasts the routing table information to neighboring nodes. The table is only advertised once a
+ * live route to a gateway is known, and then exactly once no matter how many gateways are known. Without a live route
+ * to a gateway only changed entries are sent, so that broken routes, the last gateway route among them, still reach the
+ * neighbors before their own timeouts fire.
  */
-static void broadcast_routing_table() {
-  packetbuf_copyfrom(&routing_table, sizeof(routing_table));
-  for (int i = 0; i <= last_entry; i++) {
-    // Check if the entry is still active
-    if (routing_table[i].node_type == 'G' && routing_table[i].hops != 255) {
-      // Entry is still active, mark it as inactive
-      broadcast_send(&broadcast);
+static void broadcast_routing_table(int full_dump) {
+  int i;
+
+  for (i = 0; i < num_nodes; i++) {
+    // Check if the entry is a live route to a gateway
+    if (routing_table[i].node_type == 'G' && routing_table[i].hops != INFINITY_HOPS) {
+      send_routing_frames(full_dump);
+      return;
+    }
+  }
+
+  for (i = 0; i < num_nodes; i++) {
+    if (routing_table[i].changed) {
+      send_routing_frames(0);
+      return;
     }
   }
 }
 
 /**
- * @brief Function to update routing table. It goes through the entries of the recieved routing table and adds/modifies the valid entries to it's own routing table.
- * @param received_table Received routing table
- * @param sender_addr Sender's address
+ * @brief Function to send the routing table as one or more broadcast frames
+ * @param full_dump 1 to send all entries, 0 to send only the entries that changed
+ *
+ * The table does not fit into a single frame once the network grows, so it is split into frames of at most
+ * ROUTING_ENTRIES_PER_FRAME entries. Every frame starts with the entry of this node, so that receivers can always tell
+ * the type of the sender from the first entry and refresh the routes they learned from it. The changed flags are
+ * cleared once the entries have been sent. Entries that do not fit into the airtime budget are flagged as changed and
+ * go out with a later triggered update.
  */
-static void update_routing_table(const struct routing_entry *received_table, const linkaddr_t *sender_addr) {
-    int i;
-    for (i = 0; i < MAX_NODES; i++) {
-      // Check if the entry in the received table is valid
-      if (linkaddr_cmp(&(received_table[i].node_address), &linkaddr_null) ||
-          linkaddr_cmp(&(received_table[i].node_address), &linkaddr_node_addr) ||
-          linkaddr_cmp(&(received_table[i].next_hop), &linkaddr_node_addr)) {
-        continue;
-      }
+static void send_routing_frames(int full_dump) {
+  struct routing_entry frame[ROUTING_ENTRIES_PER_FRAME];
+  int self_entry = routing_table_find(&linkaddr_node_addr, NULL);
+  int count = 1;
+  int frames_sent = 0;
+  int next_unsent = 0;
+  int deferred = 0;
+  int i;
 
-    int existing_entry = -1;
-    // Check if the node already exists in our routing table
-    for (int j = 0; j <= last_entry; j++) {
-      if (linkaddr_cmp(&(received_table[i].node_address), &(routing_table[j].node_address))) {
-        existing_entry = j;
+  if (self_entry == -1) {
+    return;
+  }
+
+  frame[0] = routing_table[self_entry];
+  for (i = 0; i < num_nodes; i++) {
+    if (i == self_entry || (!full_dump && !routing_table[i].changed)) {
+      continue;
+    }
+
+    frame[count++] = routing_table[i];
+    if (count == ROUTING_ENTRIES_PER_FRAME) {
+      if (!send_control_frame(frame, count)) {
+        deferred = 1;
         break;
       }
+      frames_sent++;
+      next_unsent = i + 1;
+      count = 1;
     }
+  }
 
-    // Update or append the entry in our routing table
-    if (existing_entry != -1) {
-      // Node already exists, update the entry
-      if (received_table[i].hops + 1 < routing_table[existing_entry].hops) {
-        routing_table[existing_entry].hops = received_table[i].hops + 1;
-
-        // Set the next hop address based on the sender's address
-        routing_table[existing_entry].next_hop = *sender_addr;
-
-        // Mark the entry as still active
-        routing_table[existing_entry].still_active = 1;
-
-      }
+  // Send the remaining entries, or at least the own entry if nothing has been sent yet
+  if (!deferred && (count > 1 || frames_sent == 0)) {
+    if (send_control_frame(frame, count)) {
+      next_unsent = num_nodes;
     } else {
-      // Node doesn't exist, append the entry
-      last_entry++;
-      routing_table[last_entry].node_address = received_table[i].node_address;
-      routing_table[last_entry].hops = received_table[i].hops + 1;
-      routing_table[last_entry].node_type = received_table[i].node_type;
-      routing_table[last_entry].node_id = received_table[i].node_id;
-
-      // Set the next hop address based on the sender's address
-      routing_table[last_entry].next_hop = *sender_addr;
-
-      // Mark the entry as still active
-      routing_table[last_entry].still_active = 1;
-
+      deferred = 1;
     }
   }
-}
 
-/**
- * @brief Function to handle timeout of entries
- *
- * This function handles the timeout of entries in the routing table. It marks inactive entries as inactive and modifies entries that were previously marked inactive to have hop count set to infinity.
- * and setsthem to infinity hops and null next hop.
- */
-static void handle_timeout() {
-  int i;
-  for (i = 1; i <= last_entry; i++) {
-    // Check if the entry is still active
-    if (routing_table[i].still_active) {
-      // Entry is still active, mark it as inactive
-      routing_table[i].still_active = 0;
-    } else {
-      // Entry is inactive, set hop count to infinity and next hop to null
-      routing_table[i].hops = INFINITY_HOPS;
-      routing_table[i].next_hop = linkaddr_null;
+  for (i = 0; i < num_nodes; i++) {
+    if (i < next_unsent) {
+      routing_table[i].changed = 0;
+    } else if (full_dump && i != self_entry) {
+      routing_table[i].changed = 1;
     }
   }
-}
 
+  if (deferred) {
+    schedule_triggered_update(0);
+  }
+}
 
 /**
- * @brief Function to receive broadcast packets. 
- * @param c Broadcast connection
- * @param from Sender's address
+ * @brief Function to broadcast one routing frame if the control plane airtime budget allows it
+ * @param frame Routing entries to send
+ * @param count Number of entries in the frame
+ * @return 1 if the frame was sent, 0 if it has to be deferred
  *
- * This function is called when a broadcast packet is received. Recieves the Routing tables and triggers the table update process.
+ * The budget is a token bucket that is refilled with CONTROL_BUDGET bytes per second and holds at most one second
+ * worth of airtime. A frame is sent as long as some budget is left, so the bucket may go negative by up to one frame.
  */
-static void recv_broadcast(struct broadcast_conn *c, const linkaddr_t *from) {
+static int send_control_frame(const struct routing_entry *frame, int count) {
+  static struct routing_frame_wire wire;
+  clock_time_t now = clock_time();
+  clock_time_t elapsed = now - control_budget_updated;
+  uint16_t length;
+
+  // Refill the budget for the time that passed since the last frame
+  if (elapsed > CLOCK_SECOND) {
+    elapsed = CLOCK_SECOND;
+  }
+  control_budget += (int32_t)(elapsed * CONTROL_BUDGET / CLOCK_SECOND);
+  if (control_budget > CONTROL_BUDGET) {
+    control_budget = CONTROL_BUDGET;
+  }
+  control_budget_updated = now;
 
-  int16_t rssi = packetbuf_attr(PACKETBUF_ATTR_RSSI);
-  printf("Received a table with RSSI: %d\n", rssi);
+  if (control_budget <= 0) {
+    control_packets_deferred++;
+    stats[STATS_CONTROL_DEFERRED]++;
+    return 0;
+  }
 
-  // Check if the received broadcast is from a neighbor node
-  if (!linkaddr_cmp(from, &linkaddr_node_addr)) {
-    // Get the received routing table
-    struct routing_entry received_table[MAX_NODES];
-    packetbuf_copyto(&received_table);
+  length = routing_frame_encode((uint8_t *)&wire, frame, count);
+  packetbuf_copyfrom(&wire, length);
+  broadcast_send(&broadcast);
 
-    // Print the received packet
-    printf("Received Routing Table from: %d.%d\n", from->u8[0], from->u8[1]);
-    // printf("Received routing table:\n");
-    int i;
-    // Update the routing table
-    update_routing_table(received_table, from);
+  control_budget -= length + CONTROL_FRAME_OVERHEAD;
+  control_packets_sent++;
+  stats[STATS_TX_CONTROL_FRAMES]++;
+  control_bytes_sent += length + CONTROL_FRAME_OVERHEAD;
 
-    // Print the updated routing table
-	printf("Updated routing table:\n");
-	printf("{");
-	for (int i = 0; i <= last_entry; i++) {
-		printf("\"Entry %d\": {", i+1);
-		printf("\"node_address\": \"%d.%d\",", routing_table->node_address.u8[0], routing_table->node_address.u8[1]);
-		// printf("\"node_address\": \"%u\",", routing_table[i].node_address);
-		printf("\"hops\": \"%u\",", routing_table[i].hops);
-		printf("\"next_hop\": \"%d.%d\",", routing_table->next_hop.u8[0], routing_table->next_hop.u8[1]);
-		printf("\"node_id\": \"%d\",", routing_table[i].node_id);
-		printf("\"node_type\": \"%c\",", routing_table[i].node_type);
-		printf("\"still_active\": \"%s\"}", routing_table[i].still_active ? "true" : "false");
-		if (i < last_entry) {
-			printf(",");
-		}
-	}
-	printf("}\r\n");
-  }
+  return 1;
 }
 
 /**
- * @brief Function to process received unicast packets
- * @param c Unicast connection
- * @param from Sender's address
+ * @brief Function to print the control plane overhead and reset the counters
  *
- * This function is called when a unicast packet is received. If the self node type is 'G', it prints the sensor data.
- * If the self node type is not 'G', it finds the node with type 'G' in the routing table and adds the packet to the forwarding queue.
+ * Rates are printed per second with one decimal, the airtime as the share of the channel capacity used by the
+ * control frames this node sent.
  */
-static void recv_unicast(struct unicast_conn *c, const linkaddr_t *from) {
-  printf("Received unicast packet from: %d.%d\n", from->u8[0], from->u8[1]);
-
-  // Check if the self node type is 'G'
-  if (self_node_type == 'G') {
-
-    struct sensor_message data;
-    packetbuf_copyto(&data);
-
-    data.path = data.path*10 + node_number;
+static void report_control_stats() {
+  uint32_t seconds = CONTROL_STATS_INTERVAL / CLOCK_SECOND;
+  uint32_t sent_rate = control_packets_sent * 10UL / seconds;
+  uint32_t received_rate = control_packets_received * 10UL / seconds;
+  uint32_t airtime = control_bytes_sent * 1000UL / (CHANNEL_CAPACITY * seconds);
+
+  LOG_INFO("Control plane: %lu.%lu packets/s sent, %lu.%lu packets/s received, %lu.%lu%% airtime (budget %u%%), %u deferred\n",
+           (unsigned long)(sent_rate / 10), (unsigned long)(sent_rate % 10),
+           (unsigned long)(received_rate / 10), (unsigned long)(received_rate % 10),
+           (unsigned long)(airtime / 10), (unsigned long)(airtime % 10),
+           CONTROL_AIRTIME_PERCENT, control_packets_deferred);
+  // Only lines dropped since the last report are worth a warning
+  if (log_dropped() != log_dropped_reported) {
+    LOG_WARN("%u log lines dropped to a full serial buffer\n", (uint16_t)(log_dropped() - log_dropped_reported));
+    log_dropped_reported = log_dropped();
+  }
 
-    printf("Sensor Packet received from: %d.%d\n", from->u8[0], from->u8[1]);
-    // Print the sensor data in JSON format
-    printf("{\"Force\": %d, \"Oximeter\": %d, \"Path\": %d,  \"Battery\": %d}\n", data.force, data.oximeter, data.path, data.batteryLevel);
+  control_packets_sent = 0;
+  control_packets_received = 0;
+  control_packets_deferred = 0;
+  control_bytes_sent = 0;
+}
 
+/**
+ * @brief Callback of the triggered update timer
+ * @param ptr Unused
+ */
+static void send_triggered_update(void *ptr) {
+  broadcast_routing_table(full_dump_requested);
+  full_dump_requested = 0;
+}
 
-    return;
+/**
+ * @brief Function to schedule a triggered routing update
+ * @param full_dump 1 if the update should carry the full table
+ *
+ * Changes are collected for a short, jittered delay so that several changes go out in one update and neighbors that
+ * learn the same change do not all send at the same time.
+ */
+static void schedule_triggered_update(int full_dump) {
+  if (full_dump) {
+    full_dump_requested = 1;
   }
 
-  // Find the node with type 'G' and forward the packet
-  int i;
-  for (i = 0; i <= last_entry; i++) {
-    if (routing_table[i].node_type == 'G') {
-      linkaddr_t next_hop = routing_table[i].next_hop;
-
-      // Retrieve the packet from the receive buffer
-      struct sensor_message data;
-      packetbuf_copyto(&data);
-
-      data.path = data.path*10 + node_number;
-      // uint8_t* packet_data = packetbuf_dataptr();
-      int packet_length = packetbuf_datalen();
-
-      // Check if the queue is full
-      if (queue_size < MAX_QUEUE_SIZE) {
-        // Add the packet to the queue
-        unicast_queue[queue_size].data =  data;
-        unicast_queue[queue_size].length = packet_length;
-        unicast_queue[queue_size].destination = next_hop;
-        queue_size++;
-
-        printf("Queued unicast packet for forwarding: %d.%d\n", next_hop.u8[0], next_hop.u8[1]);
-      } else {
-        printf("Warning: Unicast queue is full, packet dropped!\n");
-      }
-      break;
-    }
+  if (ctimer_expired(&triggered_update_timer)) {
+    ctimer_set(&triggered_update_timer, TRIGGERED_UPDATE_DELAY + random_rand() % TRIGGERED_UPDATE_DELAY,
+               send_triggered_update, NULL);
   }
 }
 
+/**
+ * @brief Function to compare two sequence numbers
+ * @param a First sequence number
+ * @param b Second sequence number
+ * @return 1 if a is newer than b, taking wrap around into account
+ */
+static int seqno_newer(uint8_t a, uint8_t b) {
+  return (int8_t)(a - b) > 0;
+}
 
+/**
+ * @brief Function to get the sort key of a node address
+ * @param addr Node address
+ * @return The address as a 16 bit number
+ */
+static uint16_t routing_key(const linkaddr_t *addr) {
+  return ((uint16_t)addr->u8[0] << 8) | addr->u8[1];
+}
 
-static const struct unicast_callbacks unicast_callbacks = {recv_unicast};
+/**
+ * @brief Function to look up a node in the routing table
+ * @param addr Address of the node
+ * @param position If not NULL, set to the index the node is at or would have to be inserted at
+ * @return Index of the entry, or -1 if the node is not in the table
+ *
+ * The table is sorted by node address, so this is a binary search.
+ */
+static int routing_table_find(const linkaddr_t *addr, int *position) {
+  uint16_t key = routing_key(addr);
+  int low = 0;
+  int high = num_nodes - 1;
+
+  while (low <= high) {
+    int mid = (low + high) / 2;
+    uint16_t mid_key = routing_key(&routing_table[mid].node_address);
+
+    if (mid_key == key) {
+      if (position != NULL) {
+        *position = mid;
+      }
+      return mid;
+    } else if (mid_key < key) {
+      low = mid + 1;
+    } else {
+      high = mid - 1;
+    }
+  }
 
-static const struct broadcast_callbacks broadcast_callbacks = {recv_broadcast};
+  if (position != NULL) {
+    *position = low;
+  }
+  return -1;
+}
 
 /**
- * @brief Main routing process to inititite the network discovery and update.
+ * @brief Function to remove an entry from the routing table
+ * @param index Index of the entry
  */
-PROCESS_THREAD(routing_process, ev, data) {
-  static struct etimer et; // Declare the etimer variable
+static void routing_table_remove(int index) {
+  memmove(&routing_table[index], &routing_table[index + 1], (num_nodes - index - 1) * sizeof(struct routing_entry));
+  num_nodes--;
+}
 
-  PROCESS_EXITHANDLER(broadcast_close(&broadcast);)
+/**
+ * @brief Function to add a node to the routing table, evicting another entry if the table is full
+ * @param addr Address of the node
+ * @param hops Number of hops to the node
+ * @return The new entry, or NULL if the table is full and no entry is worse than the new one
+ *
+ * Eviction policy: if the table is full, the worst entry is replaced. Entries that are no longer active (including the
+ * ones timed out to INFINITY_HOPS) are worse than active ones, and among those the entry with more hops is worse. An
+ * active entry is only evicted for a new entry with fewer hops. The own entry is never evicted.
+ */
+static struct routing_entry *routing_table_insert(const linkaddr_t *addr, uint8_t hops) {
+  int position;
 
-  PROCESS_BEGIN();
+  if (num_nodes >= MAX_NODES) {
+    int victim = -1;
+    for (int i = 0; i < num_nodes; i++) {
+      if (linkaddr_cmp(&routing_table[i].node_address, &linkaddr_node_addr)) {
+        continue;
+      }
+      if (victim == -1 ||
+          routing_table[i].still_active < routing_table[victim].still_active ||
+          (routing_table[i].still_active == routing_table[victim].still_active &&
+           routing_table[i].hops > routing_table[victim].hops)) {
+        victim = i;
+      }
+    }
 
-  NETSTACK_CONF_RADIO.set_value(RADIO_PARAM_CHANNEL, 15);
-  NETSTACK_CONF_RADIO.set_value(RADIO_PARAM_TXPOWER, 7);
+    if (victim == -1 || (routing_table[victim].still_active && routing_table[victim].hops <= hops)) {
+      return NULL;
+    }
 
-  broadcast_open(&broadcast, 129, &broadcast_callbacks);
+    LOG_WARN("Routing table full, evicting %d.%d\n",
+             routing_table[victim].node_address.u8[0], routing_table[victim].node_address.u8[1]);
+    routing_table_remove(victim);
+  }
 
-  // Initialize routing table for the current node
-  routing_table[num_nodes].node_address = linkaddr_node_addr;
-  routing_table[num_nodes].hops = 0;
-  routing_table[num_nodes].next_hop = linkaddr_node_addr;
-  routing_table[num_nodes].node_id = node_number2;
-  routing_table[num_nodes].node_type = self_node_type;
-  routing_table[num_nodes].still_active = 1;
+  routing_table_find(addr, &position);
+  memmove(&routing_table[position + 1], &routing_table[position], (num_nodes - position) * sizeof(struct routing_entry));
   num_nodes++;
-  last_entry++;
 
-  etimer_set(&et, CLOCK_SECOND * 5); // Set the timer for 5 seconds
-
-  while (1) {
-    PROCESS_WAIT_EVENT();
+  memset(&routing_table[position], 0, sizeof(struct routing_entry));
+  routing_table[position].node_address = *addr;
+  routing_table[position].hops = hops;
 
-    if (ev == PROCESS_EVENT_TIMER && etimer_expired(&et)) {
+  return &routing_table[position];
+}
 
-      // Broadcast the updated routing table
-      broadcast_routing_table();
+/**
+ * @brief Function to pick the gateway route sensor messages are forwarded along
+ * @return Entry of the chosen gateway, or NULL if no live route to a gateway is known
+ *
+ * Only active gateway routes with a finite hop count are considered. Among those the one with the lowest path cost wins.
+ * Gateways whose cost is within ROUTE_COST_HYSTERESIS of the lowest one count as equal and take turns, so that gateways
+ * at about the same distance share the load of their serial links.
+ */
+static struct routing_entry *select_gateway() {
+  uint8_t best_cost = COST_INFINITY;
+  uint8_t num_best = 0;
+  uint8_t pick;
+  int i;
 
-      etimer_reset(&et); // Reset the timer
+  // Find the lowest cost and how many gateways share it
+  for (i = 0; i < num_nodes; i++) {
+    struct routing_entry *entry = &routing_table[i];
+    if (entry->node_type != 'G' || !entry->still_active || entry->hops == INFINITY_HOPS ||
+        linkaddr_cmp(&entry->node_address, &linkaddr_node_addr)) {
+      continue;
+    }
+    if (entry->cost < best_cost) {
+      best_cost = entry->cost;
     }
   }
 
-  PROCESS_END();
-}
-
-/**
- * @brief Timeout process to handle network failures and timeout routing table entries that are no longer valid
- */
-PROCESS_THREAD(timeout_process, ev, data) {
-  PROCESS_BEGIN();
+  // Count the gateways that are about as cheap as the best one
+  for (i = 0; i < num_nodes; i++) {
+    struct routing_entry *entry = &routing_table[i];
+    if (entry->node_type == 'G' && entry->still_active && entry->hops != INFINITY_HOPS &&
+        !linkaddr_cmp(&entry->node_address, &linkaddr_node_addr) && entry->cost <= best_cost + ROUTE_COST_HYSTERESIS) {
+      num_best++;
+    }
+  }
 
-  while (1) {
-    // Wait for 8 seconds before triggering the timeout event
-    etimer_set(&timeout_timer, CLOCK_SECOND * 8);
-    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+  if (num_best == 0) {
+    return NULL;
+  }
 
-    // Handle timeout of entries
-    handle_timeout();
+  // Take the next gateway in turn among the cheapest ones
+  pick = gateway_turn++ % num_best;
+  for (i = 0; i < num_nodes; i++) {
+    struct routing_entry *entry = &routing_table[i];
+    if (entry->node_type != 'G' || !entry->still_active || entry->hops == INFINITY_HOPS ||
+        linkaddr_cmp(&entry->node_address, &linkaddr_node_addr) || entry->cost > best_cost + ROUTE_COST_HYSTERESIS) {
+      continue;
+    }
+    if (pick-- == 0) {
+      return entry;
+    }
   }
 
-  PROCESS_END();
+  return NULL;
 }
 
 /**
- * @brief Unicast forward process handles forwarding the packets that are stored in the queue in a way that avoids collisons.
+ * @brief Function to look up the link estimate of a neighbor
+ * @param addr Address of the neighbor
+ * @return Link estimate of the neighbor, or NULL if there is none yet
  */
-PROCESS_THREAD(unicast_forward_process, ev, data) {
-  static struct etimer et;
+static struct link_estimate *link_estimate_find(const linkaddr_t *addr) {
+  int i;
+  for (i = 0; i < num_links; i++) {
+    if (linkaddr_cmp(&links[i].address, addr)) {
+      return &links[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Function to add a link estimate for a new neighbor
+ * @param addr Address of the neighbor
+ * @param rssi RSSI the neighbor was first heard with in dBm
+ * @return Link estimate of the neighbor
+ *
+ * If the neighbor table is full, the neighbor that was not heard for the longest time is replaced. The ETX estimate
+ * starts out perfect, the RSSI penalty keeps a weak new neighbor expensive until unicasts over it prove otherwise.
+ */
+static struct link_estimate *link_estimate_add(const linkaddr_t *addr, int16_t rssi) {
+  clock_time_t now = clock_time();
+  int slot = num_links;
+  int i;
+
+  if (num_links < MAX_NEIGHBORS) {
+    num_links++;
+  } else {
+    slot = 0;
+    for (i = 1; i < num_links; i++) {
+      if (now - links[i].last_heard > now - links[slot].last_heard) {
+        slot = i;
+      }
+    }
+  }
+
+  links[slot].address = *addr;
+  links[slot].rssi = rssi * 8;
+  links[slot].etx = LINK_COST_UNIT;
+  links[slot].last_heard = now;
+
+  return &links[slot];
+}
+
+/**
+ * @brief Function to feed the RSSI of a received frame into the link estimate of its sender
+ * @param addr Address of the sender
+ * @param rssi RSSI of the frame in dBm
+ */
+static void link_estimate_rssi(const linkaddr_t *addr, int16_t rssi) {
+  struct link_estimate *link = link_estimate_find(addr);
+
+  if (link == NULL) {
+    link_estimate_add(addr, rssi);
+    return;
+  }
+
+  link->rssi += (rssi * 8 - link->rssi) >> LINK_RSSI_SHIFT;
+  link->last_heard = clock_time();
+}
+
+/**
+ * @brief Function to get the cost of the link to a neighbor
+ * @param addr Address of the neighbor
+ * @return Link cost in LINK_COST_UNIT per perfect link
+ *
+ * The cost is the ETX estimate plus a penalty of one LINK_COST_UNIT for every 16 dB the average RSSI is below
+ * LINK_RSSI_GOOD. Neighbors without an estimate get the worst RSSI penalty.
+ */
+static uint8_t link_cost(const linkaddr_t *addr) {
+  struct link_estimate *link = link_estimate_find(addr);
+  int16_t penalty;
+  uint16_t cost;
+
+  if (link == NULL) {
+    return LINK_COST_UNIT + LINK_RSSI_PENALTY_MAX;
+  }
+
+  penalty = (LINK_RSSI_GOOD * 8 - link->rssi) / 16;
+  if (penalty < 0) {
+    penalty = 0;
+  } else if (penalty > LINK_RSSI_PENALTY_MAX) {
+    penalty = LINK_RSSI_PENALTY_MAX;
+  }
+
+  cost = link->etx + penalty;
+  return cost < COST_INFINITY ? cost : COST_INFINITY - 1;
+}
+
+/**
+ * @brief Function called by the MAC layer once a unicast was sent, feeds the outcome into the link estimate
+ * @param c Unicast connection
+ * @param status MAC_TX_OK if the frame was acknowledged
+ * @param num_tx Number of transmissions
+ *
+ * An acknowledged frame counts with the number of transmissions it took, a lost frame with LINK_ETX_FAILED. The
+ * packets of the frame are then settled by forward_complete(). A report that arrives after FORWARD_SENT_TIMEOUT
+ * already settled the frame, or that is about a frame to another neighbor, is ignored, so it is never applied to the
+ * frame in flight.
+ */
+static void sent_unicast(struct unicast_conn *c, int status, int num_tx) {
+  const linkaddr_t *receiver = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+  struct link_estimate *link;
+  int16_t sample = 0;
+
+  if (!frame_in_flight || !linkaddr_cmp(receiver, &frame_destination)) {
+    return;
+  }
+  link = link_estimate_find(receiver);
+
+  if (status == MAC_TX_OK) {
+    sample = (num_tx > 0 ? num_tx : 1) * LINK_COST_UNIT;
+    if (sample > LINK_ETX_FAILED) {
+      sample = LINK_ETX_FAILED;
+    }
+  } else if (status == MAC_TX_NOACK) {
+    sample = LINK_ETX_FAILED;
+  }
+
+  // Collisions and deferred frames say nothing about the link itself
+  if (link != NULL && sample > 0) {
+    link->etx += (sample - (int16_t)link->etx) >> LINK_ETX_SHIFT;
+    link->last_heard = clock_time();
+  }
+
+  // A frame that went through lets the window shrink, a lost one suggests a collision
+  if (status == MAC_TX_OK) {
+    contention_window_update(0);
+  } else if (status == MAC_TX_COLLISION || status == MAC_TX_NOACK) {
+    stats[STATS_COLLISIONS]++;
+    contention_window_update(1);
+  }
+
+  forward_complete(status == MAC_TX_OK);
+}
+
+/**
+ * @brief Function to update routing table. It goes through the entries of the recieved routing table and adds/modifies the valid entries to it's own routing table.
+ * @param received_table Received routing table
+ * @param num_received Number of entries in the received table
+ * @param sender_addr Sender's address
+ *
+ * Routes are selected as in DSDV, with the path cost in place of the hop count: a route with a newer sequence number
+ * always replaces the current one, a route with the same sequence number only if it is cheaper by at least
+ * ROUTE_COST_HYSTERESIS, which keeps routes from flapping between neighbors of similar quality. The cost of a route is
+ * the advertised cost plus the cost of the link to the sender. Entries whose hops or next hop change, or whose cost
+ * moves by ROUTE_COST_HYSTERESIS or more, are flagged and sent in a triggered update, a new neighbor triggers a full
+ * dump so that it learns the table right away.
+ *
+ * Nodes start their sequence number over when they reboot. A node that hears its own entry with a newer sequence
+ * number continues after it, and a route a node advertises about itself is taken whatever its sequence number as long
+ * as the current route to it is broken, so a rebooted node is reachable again right away.
+ */
+static void update_routing_table(const struct routing_entry *received_table, int num_received, const linkaddr_t *sender_addr) {
+    int i;
+    for (i = 0; i < num_received; i++) {
+      // A neighbor still advertises a sequence number this node issued before it rebooted, continue after it
+      if (linkaddr_cmp(&(received_table[i].node_address), &linkaddr_node_addr)) {
+        int self = routing_table_find(&linkaddr_node_addr, NULL);
+        if (self != -1 && seqno_newer(received_table[i].seqno, routing_table[self].seqno)) {
+          routing_table[self].seqno = (received_table[i].seqno | 1) + 1;
+          schedule_triggered_update(0);
+        }
+        continue;
+      }
+
+      // Check if the entry in the received table is valid
+      if (linkaddr_cmp(&(received_table[i].node_address), &linkaddr_null) ||
+          linkaddr_cmp(&(received_table[i].node_address), &linkaddr_node_addr) ||
+          linkaddr_cmp(&(received_table[i].next_hop), &linkaddr_node_addr)) {
+        continue;
+      }
+
+    uint8_t hops = received_table[i].hops >= INFINITY_HOPS - 1 ? INFINITY_HOPS : received_table[i].hops + 1;
+    uint8_t seqno = received_table[i].seqno;
+    uint16_t cost = received_table[i].cost + link_cost(sender_addr);
+    if (hops == INFINITY_HOPS || cost >= COST_INFINITY) {
+      cost = COST_INFINITY;
+    }
+
+    // Check if the node already exists in our routing table
+    int existing_entry = routing_table_find(&(received_table[i].node_address), NULL);
+
+    // Update or append the entry in our routing table
+    if (existing_entry != -1) {
+      struct routing_entry *entry = &routing_table[existing_entry];
+
+      // Node already exists, update the entry if the route is fresher or cheaper, or the current route got more expensive
+      int same_next_hop = linkaddr_cmp(&entry->next_hop, sender_addr);
+      // A node advertising itself after a broken route may have rebooted and started its sequence number over
+      int restarted = linkaddr_cmp(&(received_table[i].node_address), sender_addr) && hops != INFINITY_HOPS &&
+                      (entry->hops == INFINITY_HOPS || !entry->still_active);
+      if (restarted || seqno_newer(seqno, entry->seqno) ||
+          (seqno == entry->seqno && (same_next_hop || cost + ROUTE_COST_HYSTERESIS <= entry->cost))) {
+        if (entry->hops != hops || !same_next_hop ||
+            cost >= entry->cost + ROUTE_COST_HYSTERESIS || cost + ROUTE_COST_HYSTERESIS <= entry->cost) {
+          entry->changed = 1;
+        }
+        entry->hops = hops;
+        entry->cost = cost;
+        entry->seqno = seqno;
+
+        // Set the next hop address based on the sender's address
+        entry->next_hop = *sender_addr;
+
+        // Mark the entry as still active
+        entry->still_active = hops != INFINITY_HOPS;
+      }
+    } else if (hops != INFINITY_HOPS) {
+      // Node doesn't exist and is reachable, insert the entry
+      struct routing_entry *entry = routing_table_insert(&(received_table[i].node_address), hops);
+      if (entry == NULL) {
+        continue;
+      }
+      entry->node_type = received_table[i].node_type;
+      entry->node_id = received_table[i].node_id;
+      entry->seqno = seqno;
+      entry->cost = cost;
+      entry->changed = 1;
+
+      // Set the next hop address based on the sender's address
+      entry->next_hop = *sender_addr;
+
+      // Mark the entry as still active
+      entry->still_active = 1;
+
+      // A new neighbor has to learn the whole table
+      if (linkaddr_cmp(&(received_table[i].node_address), sender_addr)) {
+        full_dump_requested = 1;
+      }
+    }
+  }
+
+  // Routes through the sender are confirmed by the advertisement even if they did not change
+  for (i = 0; i < num_nodes; i++) {
+    if (routing_table[i].changed) {
+      schedule_triggered_update(0);
+    }
+    if (linkaddr_cmp(&routing_table[i].next_hop, sender_addr) && routing_table[i].hops != INFINITY_HOPS) {
+      routing_table[i].still_active = 1;
+      routing_table[i].last_heard = clock_time();
+    }
+  }
+
+  // Wake up the timeout process in case it was waiting for the first live route
+  process_poll(&timeout_process);
+}
+
+/**
+ * @brief Function to mark a route as broken
+ * @param entry Routing entry
+ *
+ * The route gets infinity hops and cost and a null next hop. It is advertised in a triggered update with the next odd
+ * sequence number, so that neighbors drop it even if they heard an older even sequence number.
+ */
+static void break_route(struct routing_entry *entry) {
+  entry->still_active = 0;
+  entry->hops = INFINITY_HOPS;
+  entry->cost = COST_INFINITY;
+  entry->next_hop = linkaddr_null;
+  entry->seqno |= 1;
+  entry->changed = 1;
+  schedule_triggered_update(0);
+}
+
+/**
+ * @brief Function to handle timeout of entries
+ * @return Time until the next entry expires, 0 if no entry can expire
+ *
+ * Every live route expires ROUTE_LIFETIME after it was last confirmed, so a dead next hop is noticed one missed
+ * advertisement after it was last heard. Routes through a neighbor whose own entry expired are broken right away
+ * instead of waiting for their own deadline. Broken routes are advertised in a triggered update.
+ */
+static clock_time_t handle_timeout() {
+  clock_time_t now = clock_time();
+  clock_time_t next_timeout = 0;
+  int i, j;
+
+  for (i = 0; i < num_nodes; i++) {
+    struct routing_entry *entry = &routing_table[i];
+
+    // The own entry never expires, broken routes have nothing left to expire
+    if (linkaddr_cmp(&entry->node_address, &linkaddr_node_addr) || entry->hops == INFINITY_HOPS) {
+      continue;
+    }
+
+    clock_time_t age = now - entry->last_heard;
+    if (age < ROUTE_LIFETIME) {
+      // Remember the earliest deadline still to come
+      if (next_timeout == 0 || ROUTE_LIFETIME - age < next_timeout) {
+        next_timeout = ROUTE_LIFETIME - age;
+      }
+      continue;
+    }
+
+    LOG_INFO("Route to %d.%d expired\n", entry->node_address.u8[0], entry->node_address.u8[1]);
+
+    // A neighbor that went silent takes all routes through it along
+    if (linkaddr_cmp(&entry->next_hop, &entry->node_address)) {
+      for (j = 0; j < num_nodes; j++) {
+        if (j != i && routing_table[j].hops != INFINITY_HOPS &&
+            linkaddr_cmp(&routing_table[j].next_hop, &entry->node_address)) {
+          break_route(&routing_table[j]);
+        }
+      }
+    }
+    break_route(entry);
+  }
+
+  // A route broken along with its neighbor may have set next_timeout already, which only makes the next run early
+  return next_timeout;
+}
+
+
+/**
+ * @brief Function to take a packet descriptor from the pool
+ * @param priority Priority class of the packet
+ * @return Packet descriptor, or NULL if no descriptor is free for the priority class
+ *
+ * The queues share one pool, so a burst of one class can use the descriptors the other class does not need. The last
+ * URGENT_RESERVE descriptors are kept for urgent packets.
+ */
+static struct unicast_packet *packet_alloc(uint8_t priority) {
+  if (priority != PRIORITY_URGENT && memb_numfree(&packet_pool) <= URGENT_RESERVE) {
+    return NULL;
+  }
+  return memb_alloc(&packet_pool);
+}
+
+/**
+ * @brief Function to append a packet at the tail of a forwarding queue
+ * @param queue Queue to append to
+ * @param packet Packet descriptor taken with packet_alloc()
+ *
+ * Only the descriptor is linked into the queue, queued packets are never copied or moved.
+ */
+static void queue_push(struct unicast_queue *queue, struct unicast_packet *packet) {
+  int in_use = PACKET_POOL_SIZE - memb_numfree(&packet_pool);
+
+  list_add(queue->packets, packet);
+  queue->size++;
+
+  // Track how close the queues and the pool came to their limits
+  if (queue->size > queue_high_water[queue - unicast_queues]) {
+    queue_high_water[queue - unicast_queues] = queue->size;
+  }
+  if (in_use > pool_high_water) {
+    pool_high_water = in_use;
+  }
+}
+
+/**
+ * @brief Function to remove a packet from a forwarding queue and return its descriptor to the pool
+ * @param queue Queue to remove from
+ * @param packet Packet to remove
+ */
+static void queue_remove(struct unicast_queue *queue, struct unicast_packet *packet) {
+  list_remove(queue->packets, packet);
+  memb_free(&packet_pool, packet);
+  queue->size--;
+}
+
+/**
+ * @brief Function to check whether a queued packet may be sent now
+ * @param packet Queued packet
+ * @param now Current time
+ * @return 1 if the packet is neither in flight nor backing off, 0 otherwise
+ */
+static int packet_ready(const struct unicast_packet *packet, clock_time_t now) {
+  return !packet->in_flight && (packet->retries == 0 || now - packet->last_attempt >= packet->backoff);
+}
+
+/**
+ * @brief Function to select the packet that should be sent next
+ * @param wait Set to the time until the next backoff ends if no packet is ready, 0 if nothing is backing off
+ * @return The oldest ready packet of the highest priority queue, or NULL if no packet is ready
+ *
+ * Urgent packets are always sent before any normal packet. Packets that are backing off are skipped, so a packet
+ * waiting for its retransmission never holds up the packets behind it.
+ */
+static struct unicast_packet *queue_next(clock_time_t *wait) {
+  clock_time_t now = clock_time();
+  struct unicast_packet *packet;
+  int p;
+
+  *wait = 0;
+  for (p = NUM_PRIORITIES - 1; p >= 0; p--) {
+    for (packet = list_head(unicast_queues[p].packets); packet != NULL; packet = list_item_next(packet)) {
+      if (packet_ready(packet, now)) {
+        return packet;
+      }
+
+      // Remember the earliest end of a backoff
+      if (!packet->in_flight) {
+        clock_time_t left = packet->backoff - (now - packet->last_attempt);
+        if (*wait == 0 || left < *wait) {
+          *wait = left;
+        }
+      }
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Function to settle the packets of the frame the MAC layer reported on
+ * @param delivered 1 if the frame was acknowledged, 0 otherwise
+ *
+ * Delivered packets leave their queue. Packets of a lost frame stay in their queue and back off for FORWARD_BACKOFF,
+ * doubled with every further failure and with a random jitter of up to FORWARD_BACKOFF, until they were retransmitted
+ * FORWARD_MAX_RETRIES times. The outcome is counted for the neighbor the frame was sent to.
+ */
+static void forward_complete(int delivered) {
+  clock_time_t now = clock_time();
+  struct unicast_packet *packet, *next;
+  int p;
+
+  for (p = 0; p < NUM_PRIORITIES; p++) {
+    struct unicast_queue *queue = &unicast_queues[p];
+
+    for (packet = list_head(queue->packets); packet != NULL; packet = next) {
+      struct link_estimate *link;
+
+      // Look up the next packet before this one may go back to the pool
+      next = list_item_next(packet);
+      if (!packet->in_flight) {
+        continue;
+      }
+      packet->in_flight = 0;
+      link = link_estimate_find(&packet->destination);
+
+      if (delivered) {
+        stats[STATS_FORWARDED]++;
+        if (link != NULL) {
+          link->delivered++;
+        }
+        queue_remove(queue, packet);
+      } else if (packet->retries >= FORWARD_MAX_RETRIES) {
+        LOG_WARN("Dropping packet %u from %u to %d.%d after %u retransmissions\n", packet->data.seqno,
+                 packet->data.origin, packet->destination.u8[0], packet->destination.u8[1], packet->retries);
+        stats[STATS_DROP_RETRIES]++;
+        if (link != NULL) {
+          link->lost++;
+        }
+        queue_remove(queue, packet);
+      } else {
+        stats[STATS_RETRANSMISSIONS]++;
+        if (link != NULL) {
+          link->retransmissions++;
+        }
+        packet->backoff = (FORWARD_BACKOFF << packet->retries) + random_rand() % FORWARD_BACKOFF;
+        packet->last_attempt = now;
+        packet->retries++;
+      }
+    }
+  }
+
+  frame_in_flight = 0;
+  process_poll(&unicast_forward_process);
+}
+
+/**
+ * @brief Function to start a random backoff within the contention window
+ *
+ * The backoff is timed with an rtimer, so its resolution is far below a clock tick and switches that want to send at
+ * the same time pick well separated slots.
+ */
+static void backoff_start() {
+  rtimer_clock_t backoff = 1 + random_rand() % contention_window;
+
+  backoff_state = BACKOFF_RUNNING;
+#if RDC_OWNS_RTIMER
+  // Rounded up to whole clock ticks, ContikiMAC checks the channel before every strobe anyway
+  ctimer_set(&backoff_timer, 1 + backoff * CLOCK_SECOND / RTIMER_SECOND, backoff_expired_callback, NULL);
+#else
+  rtimer_set(&backoff_timer, RTIMER_NOW() + backoff, 1, backoff_expired, NULL);
+#endif
+}
+
+#if RDC_OWNS_RTIMER
+/**
+ * @brief Function called by the ctimer when the backoff ends
+ * @param ptr Unused
+ */
+static void backoff_expired_callback(void *ptr) {
+  backoff_expired(NULL, NULL);
+}
+#endif
+
+/**
+ * @brief Function called by the rtimer when the backoff ends
+ * @param t Backoff timer
+ * @param ptr Unused
+ *
+ * Runs in interrupt context, so it only hands over to the forward process.
+ */
+static void backoff_expired(struct rtimer *t, void *ptr) {
+  backoff_state = BACKOFF_DONE;
+  process_poll(&unicast_forward_process);
+}
+
+/**
+ * @brief Function to adapt the contention window to the contention observed
+ * @param congested 1 if the channel was busy or a frame was lost, 0 if a frame went through
+ *
+ * The window doubles on contention and shrinks by a quarter after every frame that went through, so it settles at a
+ * size where collisions are rare for the number of switches that currently compete for the channel.
+ */
+static void contention_window_update(int congested) {
+  if (congested) {
+    contention_window = contention_window * 2 < BACKOFF_CW_MAX ? contention_window * 2 : BACKOFF_CW_MAX;
+  } else {
+    contention_window -= contention_window / 4;
+    if (contention_window < BACKOFF_CW_MIN) {
+      contention_window = BACKOFF_CW_MIN;
+    }
+  }
+}
+
+/**
+ * @brief Function to receive broadcast packets. 
+ * @param c Broadcast connection
+ * @param from Sender's address
+ *
+ * This function is called when a broadcast packet is received. Recieves the Routing tables and triggers the table update process.
+ */
+static void recv_broadcast(struct broadcast_conn *c, const linkaddr_t *from) {
+
+  int16_t rssi = (int8_t)packetbuf_attr(PACKETBUF_ATTR_RSSI);
+  LOG_DBG("Received a table with RSSI: %d\n", rssi);
+  control_packets_received++;
+  stats[STATS_RX_CONTROL_FRAMES]++;
+
+  // Check if the received broadcast is from a neighbor node
+  if (!linkaddr_cmp(from, &linkaddr_node_addr)) {
+    // Update the link estimate before the routes through the sender are costed
+    link_estimate_rssi(from, rssi);
+
+    // Get the received routing table
+    struct routing_entry received_table[ROUTING_ENTRIES_PER_FRAME];
+    int num_received = routing_frame_decode(packetbuf_dataptr(), packetbuf_datalen(),
+                                            received_table, ROUTING_ENTRIES_PER_FRAME);
+    if (num_received == 0) {
+      LOG_WARN("Ignoring malformed routing frame from: %d.%d\n", from->u8[0], from->u8[1]);
+      stats[STATS_DROP_MALFORMED]++;
+      return;
+    }
+
+    // Print the received packet
+    LOG_DBG("Received Routing Table from: %d.%d\n", from->u8[0], from->u8[1]);
+    // Update the routing table
+    update_routing_table(received_table, num_received, from);
+
+    // The report process prints the updated routing table, the serial line is too slow to do it here
+    routing_table_updated = 1;
+    process_poll(&report_process);
+  }
+}
+
+/**
+ * @brief Function to print a sample of a sensor message in JSON format for the GUI
+ * @param data Sensor message
+ * @param sample Number of the sample, 0 for the first one
+ *
+ * "Origin" is the device id of the player. The path is printed as a list of node ids starting with the origin,
+ * followed by the list of RSSI values each hop received the packet with. A batch is expanded into one line per sample,
+ * numbered by "Sample" and with the age of that sample, so the GUI can place every sample in time.
+ */
+static void print_sensor_message(const struct sensor_message *data, int sample) {
+  struct sensor_sample samples[BATCH_MAX_SAMPLES];
+  int count = sensor_batch_decode(data, samples, BATCH_MAX_SAMPLES);
+  // Later samples of a batch were taken after the first one, so they are younger
+  uint32_t offset = (uint32_t)sample * data->batch_spacing;
+  uint8_t i;
+
+  if (sample >= count) {
+    return;
+  }
+
+  log_printf("{\"Force\": %d, \"Oximeter\": %d, \"ForceRange\": [%d, %d], \"OximeterRange\": [%d, %d], ",
+             samples[sample].force, samples[sample].oximeter, data->force_min, data->force_max, data->oximeter_min,
+             data->oximeter_max);
+  log_printf("\"Origin\": %u, \"Seq\": %u, \"Sample\": %d, \"Age\": %lu, \"Path\": [", data->origin, data->seqno,
+             sample, data->age > offset ? (unsigned long)(data->age - offset) : 0UL);
+  for (i = 0; i < data->path_len; i++) {
+    log_printf(i > 0 ? ", %u" : "%u", data->path[i]);
+  }
+  log_printf("], \"RSSI\": [");
+  for (i = 0; i < data->path_len; i++) {
+    log_printf(i > 0 ? ", %d" : "%d", data->path_rssi[i]);
+  }
+  log_printf("], \"Truncated\": %s, \"Battery\": %d, \"Priority\": %d, \"Interval\": %u}\n",
+             data->path_truncated ? "true" : "false", samples[sample].batteryLevel, data->priority, data->interval);
+}
+
+/**
+ * @brief Function to print a routing table entry in JSON format for the GUI
+ * @param index Position of the entry in the routing table
+ *
+ * Every entry is a line of its own, so that a whole table never has to fit into the log buffer at once.
+ */
+static void print_routing_entry(int index) {
+  const struct routing_entry *entry = &routing_table[index];
+
+  log_printf("{\"Entry %d\": {\"node_address\": \"%d.%d\",\"hops\": \"%u\",\"next_hop\": \"%d.%d\","
+             "\"node_id\": \"%d\",\"node_type\": \"%c\",\"seqno\": \"%u\",\"cost\": \"%u\","
+             "\"still_active\": \"%s\"}}\r\n",
+             index + 1, entry->node_address.u8[0], entry->node_address.u8[1], entry->hops, entry->next_hop.u8[0],
+             entry->next_hop.u8[1], entry->node_id, entry->node_type, entry->seqno, entry->cost,
+             entry->still_active ? "true" : "false");
+}
+
+/**
+ * @brief Function to print an energy summary in JSON format for the GUI
+ * @param energy Energy summary
+ *
+ * "Energy" holds the device id. The times are totals in ms since boot, wrapped around at 24 bits.
+ */
+static void print_energy_summary(const struct energy_summary *energy) {
+  log_printf("{\"Energy\": %u, \"CPU\": %lu, \"LPM\": %lu, \"Transmit\": %lu, \"Listen\": %lu}\n", energy->node_id,
+             (unsigned long)energy->cpu, (unsigned long)energy->lpm, (unsigned long)energy->transmit,
+             (unsigned long)energy->listen);
+}
+
+/**
+ * @brief Function to process received unicast packets
+ * @param c Unicast connection
+ * @param from Sender's address
+ *
+ * This function is called when a unicast packet is received. If the self node type is 'G', it prints the sensor data.
+ * If the self node type is not 'G', it picks a gateway with select_gateway() and adds the packet to the forwarding queue.
+ * Bundles built by other switches are split up so that every message gets its own hop appended and is queued by its
+ * priority.
+ */
+static void recv_unicast(struct unicast_conn *c, const linkaddr_t *from) {
+  static struct sensor_message messages[AGGREGATE_MAX_MESSAGES];
+  int8_t rssi = packetbuf_attr(PACKETBUF_ATTR_RSSI);
+  int num_messages;
+  int num_queued = 0;
+  int i;
+
+  LOG_DBG("Received unicast packet from: %d.%d\n", from->u8[0], from->u8[1]);
+  link_estimate_rssi(from, rssi);
+  stats[STATS_RX_DATA_FRAMES]++;
+
+  // Retrieve the message, or the bundle of messages, from the receive buffer
+  if (sensor_message_decode(packetbuf_dataptr(), packetbuf_datalen(), &messages[0])) {
+    num_messages = 1;
+  } else {
+    num_messages = aggregate_decode(packetbuf_dataptr(), packetbuf_datalen(), messages, AGGREGATE_MAX_MESSAGES);
+  }
+  if (num_messages == 0) {
+    LOG_WARN("Ignoring malformed sensor packet from: %d.%d\n", from->u8[0], from->u8[1]);
+    stats[STATS_DROP_MALFORMED]++;
+    return;
+  }
+  stats[STATS_RX_DATA_MESSAGES] += num_messages;
+
+  for (i = 0; i < num_messages; i++) {
+    // Drop copies that were already forwarded or printed before they take up a packet descriptor
+    if (dedup_check(&messages[i])) {
+      LOG_DBG("Dropping duplicate %u from %u (%u dropped so far)\n",
+              messages[i].seqno, messages[i].origin, stats[STATS_DROP_DUPLICATE]);
+      continue;
+    }
+
+    sensor_message_append_hop(&messages[i], node_number, rssi);
+
+    // Check if the self node type is 'G'
+    if (self_node_type == 'G') {
+      LOG_DBG("Sensor Packet received from: %d.%d\n", from->u8[0], from->u8[1]);
+      // The report process prints the sensor data in JSON format once the serial line has room for it
+      if (report_sensor_message(&messages[i])) {
+        stats[STATS_DELIVERED]++;
+      }
+    } else {
+      num_queued += enqueue_sensor_message(&messages[i]);
+    }
+  }
+
+  if (num_queued > 0) {
+    // Wake up the forward process right away instead of waiting for a timer
+    process_post(&unicast_forward_process, packet_queued_event, NULL);
+  }
+}
+
+/**
+ * @brief Function to check whether a sensor message was seen before and remember it otherwise
+ * @param data Sensor message
+ * @return 1 if the message is a duplicate, 0 otherwise
+ *
+ * Messages are identified by the device id of their origin and their sequence number. For every origin the
+ * newest sequence number and a bitmap of the DEDUP_WINDOW numbers below it are kept, as in a sliding replay window.
+ * An origin picks a new epoch every time it boots and starts its sequence numbers over, so a new epoch, or a sequence
+ * number far behind the newest one, starts the window over. If the cache is full, the origin that was least recently
+ * heard from is replaced.
+ */
+static int dedup_check(const struct sensor_message *data) {
+  struct dedup_entry *entry = NULL;
+  uint8_t distance;
+  int i;
+
+  // Look up the origin, or take over the least recently used entry
+  for (i = 0; i < dedup_cache_size; i++) {
+    if (dedup_cache[i].origin == data->origin) {
+      entry = &dedup_cache[i];
+      break;
+    }
+  }
+  if (entry == NULL) {
+    if (dedup_cache_size < DEDUP_CACHE_SIZE) {
+      entry = &dedup_cache[dedup_cache_size++];
+    } else {
+      entry = &dedup_cache[0];
+      for (i = 1; i < DEDUP_CACHE_SIZE; i++) {
+        if (clock_time() - dedup_cache[i].last_used > clock_time() - entry->last_used) {
+          entry = &dedup_cache[i];
+        }
+      }
+    }
+    entry->origin = data->origin;
+    entry->epoch = data->epoch;
+    entry->newest = data->seqno;
+    entry->window = 1;
+    entry->last_used = clock_time();
+    return 0;
+  }
+  entry->last_used = clock_time();
+
+  if (entry->epoch != data->epoch) {
+    // The origin restarted, its sequence numbers start over
+    entry->epoch = data->epoch;
+    entry->newest = data->seqno;
+    entry->window = 1;
+    return 0;
+  }
+
+  distance = entry->newest - data->seqno;
+  if (distance == 0) {
+    stats[STATS_DROP_DUPLICATE]++;
+    return 1;
+  }
+  if (distance < DEDUP_WINDOW) {
+    // Older message within the window
+    if (entry->window & (1UL << distance)) {
+      stats[STATS_DROP_DUPLICATE]++;
+      return 1;
+    }
+    entry->window |= 1UL << distance;
+    return 0;
+  }
+
+  distance = data->seqno - entry->newest;
+  if (distance < 128) {
+    // Newer message, slide the window
+    entry->window = distance < DEDUP_WINDOW ? (entry->window << distance) | 1 : 1;
+  } else {
+    // Far behind the window, the origin restarted its sequence numbers
+    entry->window = 1;
+  }
+  entry->newest = data->seqno;
+  return 0;
+}
+
+/**
+ * @brief Function to add a sensor message to the forwarding queue of its priority class
+ * @param data Sensor message
+ * @return 1 if the message was queued, 0 if there is no route to a gateway or no packet descriptor is free
+ *
+ * The message is forwarded to the next hop of the gateway chosen by select_gateway().
+ */
+static int enqueue_sensor_message(const struct sensor_message *data) {
+  struct routing_entry *gateway = select_gateway();
+  if (gateway == NULL) {
+    LOG_WARN("Warning: No live route to a gateway, packet dropped!\n");
+    stats[STATS_DROP_NO_ROUTE]++;
+    return 0;
+  }
+
+  // Urgent readings go to their own queue, anything unknown is treated as normal
+  uint8_t priority = data->priority == PRIORITY_URGENT ? PRIORITY_URGENT : PRIORITY_NORMAL;
+  struct unicast_queue *queue = &unicast_queues[priority];
+
+  // Take a descriptor for the packet unless the pool is exhausted
+  struct unicast_packet *packet = packet_alloc(priority);
+  if (packet == NULL) {
+    // The counters of the two classes follow each other in the order of the priorities
+    stats[STATS_DROP_QUEUE_FULL_NORMAL + priority]++;
+    LOG_WARN("Warning: Unicast queue %d is full, packet dropped! (%u dropped from it so far)\n", priority,
+             stats[STATS_DROP_QUEUE_FULL_NORMAL + priority]);
+    return 0;
+  }
+
+  packet->data = *data;
+  packet->length = sensor_message_encoded_len(data);
+  packet->destination = gateway->next_hop;
+  packet->queued_at = clock_time();
+  packet->retries = 0;
+  packet->in_flight = 0;
+  packet->last_attempt = 0;
+  packet->backoff = 0;
+  queue_push(queue, packet);
+
+  LOG_DBG("Queued unicast packet for gateway %d via: %d.%d\n", gateway->node_id,
+          packet->destination.u8[0], packet->destination.u8[1]);
+  return 1;
+}
+
+/**
+ * @brief Function to queue a sensor message a gateway delivered for the report process
+ * @param data Sensor message
+ * @return 1 if the message was queued, 0 if no packet descriptor was free
+ *
+ * A gateway forwards nothing, so its packet descriptors hold the messages until the serial line has room for them.
+ */
+static int report_sensor_message(const struct sensor_message *data) {
+  uint8_t priority = data->priority == PRIORITY_URGENT ? PRIORITY_URGENT : PRIORITY_NORMAL;
+  struct unicast_packet *packet = packet_alloc(priority);
+
+  if (packet == NULL) {
+    stats[STATS_DROP_QUEUE_FULL_NORMAL + priority]++;
+    LOG_WARN("Warning: Report queue is full, packet dropped! (%u dropped so far)\n",
+             stats[STATS_DROP_QUEUE_FULL_NORMAL + priority]);
+    return 0;
+  }
+  packet->data = *data;
+  packet->queued_at = clock_time();
+  list_add(report_queue, packet);
+  process_poll(&report_process);
+
+  return 1;
+}
+
+/**
+ * @brief Function to get how long the forward process should wait before sending the next bundle
+ * @param next Packet that would be sent next
+ * @return 0 to send right away, otherwise the remaining hold time
+ *
+ * Urgent packets and retransmissions are never held back. Normal packets are held for at most AGGREGATION_MAX_HOLD
+ * after the oldest one was queued, unless enough ready packets to the same next hop are queued to fill a bundle.
+ */
+static clock_time_t bundle_hold_time(const struct unicast_packet *next) {
+  struct unicast_packet *packet;
+  clock_time_t now = clock_time();
+  clock_time_t waited;
+  uint16_t length = 2;
+
+  if (next->data.priority == PRIORITY_URGENT || next->retries > 0) {
+    return 0;
+  }
+
+  waited = now - next->queued_at;
+  if (waited >= AGGREGATION_MAX_HOLD) {
+    return 0;
+  }
+
+  for (packet = list_head(unicast_queues[PRIORITY_NORMAL].packets); packet != NULL; packet = list_item_next(packet)) {
+    if (!packet_ready(packet, now)) {
+      continue;
+    }
+    if (!linkaddr_cmp(&packet->destination, &next->destination)) {
+      return 0;
+    }
+    length += 1 + packet->length;
+    if (length > AGGREGATE_MAX_LEN) {
+      return 0;
+    }
+  }
+
+  return AGGREGATION_MAX_HOLD - waited;
+}
+
+/**
+ * @brief Function to bundle the ready packets that go to the same next hop
+ * @param destination Next hop of the bundle
+ * @return Length of the frame in bundle
+ *
+ * Packets are taken urgent queue first and in queue order until the next packet does not fit. Packets to other next
+ * hops or backing off are skipped. The packets stay in their queues, marked as in flight, until forward_complete()
+ * learns whether the frame was acknowledged. A single packet is sent as a plain sensor message.
+ */
+static uint16_t build_bundle(const linkaddr_t *destination) {
+  clock_time_t now = clock_time();
+  uint16_t length = aggregate_begin(bundle);
+  struct sensor_message message;
+  struct sensor_message first;
+  int energy_attached;
+  struct unicast_packet *packet;
+  int full = 0;
+  int count = 0;
+  int p;
+
+  for (p = NUM_PRIORITIES - 1; p >= 0 && !full; p--) {
+    for (packet = list_head(unicast_queues[p].packets); packet != NULL; packet = list_item_next(packet)) {
+      uint16_t new_length;
+
+      if (!packet_ready(packet, now) || !linkaddr_cmp(&packet->destination, destination)) {
+        continue;
+      }
+      // The copy on air carries the time spent here, the queued one keeps its age for a retransmission
+      message = packet->data;
+      sensor_message_add_age(&message, now - packet->queued_at);
+      // A due energy summary rides along with the first message that has no summary yet
+      energy_attached = !message.has_energy && timer_expired(&energy_timer);
+      if (energy_attached) {
+        energy_summary_read(&message.energy);
+        message.has_energy = 1;
+      }
+      new_length = aggregate_append(bundle, length, &message);
+      if (new_length == 0) {
+        // Lower priority packets may only follow if the bundle did not fill up
+        full = 1;
+        break;
+      }
+      if (energy_attached) {
+        timer_reset(&energy_timer);
+      }
+
+      if (count == 0) {
+        first = message;
+      }
+      packet->in_flight = 1;
+      length = new_length;
+      count++;
+    }
+  }
+
+  if (count == 1) {
+    length = sensor_message_encode(bundle, &first);
+  }
+
+  return length;
+}
+
+/**
+ * @brief Function to print the delivery statistics of every neighbor packets were forwarded to
+ *
+ * The counters are totals since boot, so the loss rate of a hop is lost / (delivered + lost).
+ */
+static void report_forward_stats() {
+  int i;
+
+  LOG_INFO("Transmit scheduler: contention window %lu us, channel busy %u times, %u collisions\n",
+           (unsigned long)contention_window * 1000000UL / RTIMER_SECOND, stats[STATS_RADIO_BUSY], stats[STATS_COLLISIONS]);
+  for (i = 0; i < num_links; i++) {
+    if (links[i].delivered + links[i].retransmissions + links[i].lost == 0) {
+      continue;
+    }
+    LOG_INFO("Forwarding to %d.%d: %u delivered, %u retransmissions, %u lost, ETX %u.%u\n",
+             links[i].address.u8[0], links[i].address.u8[1], links[i].delivered, links[i].retransmissions,
+             links[i].lost, links[i].etx / LINK_COST_UNIT, (links[i].etx % LINK_COST_UNIT) * 10 / LINK_COST_UNIT);
+  }
+}
+
+
+
+static const struct unicast_callbacks unicast_callbacks = {recv_unicast, sent_unicast};
+
+static const struct broadcast_callbacks broadcast_callbacks = {recv_broadcast};
+
+/**
+ * @brief Main routing process to inititite the network discovery and update.
+ */
+PROCESS_THREAD(routing_process, ev, data) {
+  static struct etimer et; // Declare the etimer variable
+  static uint8_t advertisement_count = 0; // Number of periodic advertisements sent
+  static struct etimer stats_timer; // Timer for the control plane overhead report
+
+  PROCESS_EXITHANDLER(broadcast_close(&broadcast);)
 
   PROCESS_BEGIN();
 
-  unicast_open(&unicast, 146, &unicast_callbacks);
+  NETSTACK_CONF_RADIO.set_value(RADIO_PARAM_CHANNEL, 15);
+  NETSTACK_CONF_RADIO.set_value(RADIO_PARAM_TXPOWER, 7);
+#if RDC_PROFILE != RDC_PROFILE_ALWAYS_ON
+  // Keep listening all the time, ContikiMAC still strobes the advertisements so that sleeping nodes hear them
+  NETSTACK_RDC.off(1);
+#endif
 
-  etimer_set(&et, CLOCK_SECOND); // Set the timer interval to 1 second
+  broadcast_open(&broadcast, 129, &broadcast_callbacks);
+
+  // The routing process starts first, so the ids are set before any packet is handled
+  node_number = linkaddr_node_addr.u8[LINKADDR_SIZE - 1];
+  node_number2 = node_number;
+
+  // Initialize routing table for the current node
+  struct routing_entry *self_entry = routing_table_insert(&linkaddr_node_addr, 0);
+  self_entry->next_hop = linkaddr_node_addr;
+  self_entry->node_id = node_number2;
+  self_entry->node_type = self_node_type;
+  self_entry->still_active = 1;
+
+  etimer_set(&et, ADVERTISEMENT_INTERVAL); // Set the timer for 5 seconds
+  etimer_set(&stats_timer, CONTROL_STATS_INTERVAL);
+  timer_set(&energy_timer, ENERGY_REPORT_INTERVAL);
+  control_budget_updated = clock_time();
 
   while (1) {
-    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    PROCESS_WAIT_EVENT();
 
-    // Check if there are packets in the queue
-    if (queue_size > 0) {
-      // Check if the node is currently receiving or sending a packet
-      if (NETSTACK_RADIO.pending_packet()) {
-        // If the node is busy, print a message and skip forwarding for now
-        printf("Node busy, cannot forward unicast packet at the moment!\n");
+    if (ev == PROCESS_EVENT_TIMER && etimer_expired(&et)) {
+
+      // Issue a new sequence number for the own entry
+      int self = routing_table_find(&linkaddr_node_addr, NULL);
+      routing_table[self].seqno += 2;
+
+      // The periodic advertisement replaces a pending triggered update
+      advertisement_count++;
+      ctimer_stop(&triggered_update_timer);
+
+      // Broadcast the changed entries, and occasionally the full routing table
+      broadcast_routing_table(full_dump_requested || advertisement_count % FULL_DUMP_INTERVAL == 0);
+      full_dump_requested = 0;
+
+      // Jitter the next advertisement so that neighbors do not stay synchronized
+      etimer_set(&et, ADVERTISEMENT_INTERVAL - ADVERTISEMENT_JITTER / 2 + random_rand() % ADVERTISEMENT_JITTER);
+    }
+
+    // The statistics record can also be requested over serial
+    if (ev == serial_line_event_message && data != NULL && strcmp((char *)data, "stats") == 0) {
+      report_stats_record();
+    }
+
+    if (ev == PROCESS_EVENT_TIMER && etimer_expired(&stats_timer)) {
+      report_control_stats();
+      report_forward_stats();
+      report_stats_record();
+      etimer_reset(&stats_timer);
+
+      // The gateway prints its own energy summary, it has nobody to piggyback it on
+      if (self_node_type == 'G' && timer_expired(&energy_timer)) {
+        struct energy_summary energy;
+        energy_summary_read(&energy);
+        print_energy_summary(&energy);
+        timer_reset(&energy_timer);
+      }
+    }
+  }
+
+  PROCESS_END();
+}
+
+/**
+ * @brief Timeout process to handle network failures and timeout routing table entries that are no longer valid
+ *
+ * Instead of sweeping the table at a fixed interval, the process sleeps until the earliest deadline of a live route.
+ * If there is no live route it sleeps until update_routing_table polls it.
+ */
+PROCESS_THREAD(timeout_process, ev, data) {
+  static clock_time_t next_timeout;
+
+  PROCESS_BEGIN();
+
+  while (1) {
+    // Expire the routes that are due and find the next deadline
+    next_timeout = handle_timeout();
+
+    if (next_timeout > 0) {
+      etimer_set(&timeout_timer, next_timeout);
+      PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER && etimer_expired(&timeout_timer));
+    } else {
+      PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    }
+  }
+
+  PROCESS_END();
+}
+
+/**
+ * @brief Report process prints the delivered sensor messages and the routing table for the GUI
+ *
+ * Printing from the receive callbacks would overrun the log buffer, so a gateway queues the messages it delivers and
+ * this process prints them one line at a time, each once the log buffer has room for the longest line. The routing
+ * table is printed the same way, one entry per line, at most once per TABLE_REPORT_INTERVAL after routing frames
+ * updated it. Entries that move while the process waits may be skipped or printed twice, the GUI keys them by node id
+ * and the next report catches up.
+ */
+PROCESS_THREAD(report_process, ev, data) {
+  static struct etimer table_timer;
+  static struct etimer drain_timer;
+  static int line = 0; // Next line of the message at the head of the report queue
+  static int entry = 0; // Next routing table entry, 0 if no table report is running
+  struct unicast_packet *packet;
+  int num_lines;
+
+  PROCESS_BEGIN();
+
+  list_init(report_queue);
+  etimer_set(&table_timer, TABLE_REPORT_INTERVAL);
+
+  while (1) {
+    PROCESS_WAIT_UNTIL(list_head(report_queue) != NULL || entry > 0 ||
+                       (routing_table_updated && etimer_expired(&table_timer)));
+
+    // Give the log process a clock tick to make room for the next line
+    if (log_space() < REPORT_LINE_MAX) {
+      etimer_set(&drain_timer, 1);
+      PROCESS_WAIT_UNTIL(etimer_expired(&drain_timer));
+      continue;
+    }
+
+    // Sensor messages go first, one line per sample followed by the energy summary
+    packet = list_head(report_queue);
+    if (packet != NULL) {
+      if (line == 0) {
+        sensor_message_add_age(&packet->data, clock_time() - packet->queued_at);
+      }
+      num_lines = packet->data.batch_count + 1;
+      if (line < num_lines) {
+        print_sensor_message(&packet->data, line);
       } else {
-        // Retrieve the next packet from the queue
-        struct unicast_packet packet = unicast_queue[0];
-        printf("Force: %d\r\n", packet.data.force);
-        printf("Oximeter: %d\r\n", packet.data.oximeter);
-        printf("Path: %d\r\n", packet.data.path);
-        printf("Battery: %d\r\n", packet.data.batteryLevel);
-
-        // Copy the packet data to the packet buffer
-        packetbuf_copyfrom(&packet.data, sizeof(packet.data));
-        // memcpy(packetbuf_dataptr(), packet.data, packet.length);
-        // packetbuf_set_datalen(packet.length);
-
-        // Send the packet using unicast
-        // Replace the following line with your own implementation of sending the packet
-        printf("Forwarding unicast packet to: %d.%d\n", packet.destination.u8[0], packet.destination.u8[1]);
-        unicast_send(&unicast, &packet.destination);
-
-        // Remove the forwarded packet from the queue
-        int i;
-        for (i = 1; i < queue_size; i++) {
-          unicast_queue[i - 1] = unicast_queue[i];
+        print_energy_summary(&packet->data.energy);
+      }
+      line++;
+      if (line >= num_lines + packet->data.has_energy) {
+        list_remove(report_queue, packet);
+        memb_free(&packet_pool, packet);
+        line = 0;
+      }
+      continue;
+    }
+
+    if (entry == 0) {
+      routing_table_updated = 0;
+      LOG_DBG("Updated routing table:\n");
+    }
+    if (entry < num_nodes) {
+      print_routing_entry(entry);
+    }
+    entry++;
+    if (entry >= num_nodes) {
+      entry = 0;
+      etimer_set(&table_timer, TABLE_REPORT_INTERVAL);
+    }
+  }
+
+  PROCESS_END();
+}
+
+/**
+ * @brief Function to store a 16 bit value little-endian
+ * @param buf Buffer of at least 2 bytes
+ * @param value Value to store
+ */
+static void put_uint16(uint8_t *buf, uint16_t value) {
+  buf[0] = value & 0xFF;
+  buf[1] = value >> 8;
+}
+
+/**
+ * @brief Function to print the forwarding statistics as one binary record
+ *
+ * The record is the struct stats_record_wire defined in protocol.h, printed in hex on a single line starting with
+ * "STATS " so that it passes the serial line unharmed and the GUI ignores it. Only the first STATS_MAX_NEIGHBORS
+ * neighbors packets were forwarded to are included.
+ */
+static void report_stats_record() {
+  unsigned long uptime = clock_seconds();
+  uint16_t length;
+  int i;
+
+  stats_record.header = (PROTOCOL_VERSION << 4) | MSG_TYPE_STATS;
+  stats_record.node_id = node_number;
+  for (i = 0; i < 4; i++) {
+    stats_record.uptime[i] = (uptime >> (8 * i)) & 0xFF;
+  }
+  stats[STATS_DROP_LOG] = log_dropped();
+  for (i = 0; i < STATS_NUM_COUNTERS; i++) {
+    put_uint16(&stats_record.counters[2 * i], stats[i]);
+  }
+  stats_record.queue_high_water[0] = queue_high_water[PRIORITY_NORMAL];
+  stats_record.queue_high_water[1] = queue_high_water[PRIORITY_URGENT];
+  stats_record.pool_high_water = pool_high_water;
+  stats_record.pool_size = PACKET_POOL_SIZE;
+
+  stats_record.num_neighbors = 0;
+  for (i = 0; i < num_links && stats_record.num_neighbors < STATS_MAX_NEIGHBORS; i++) {
+    struct stats_neighbor_wire *neighbor = &stats_record.neighbors[stats_record.num_neighbors];
+    if (links[i].delivered + links[i].retransmissions + links[i].lost == 0) {
+      continue;
+    }
+    memcpy(neighbor->address, links[i].address.u8, LINKADDR_SIZE);
+    put_uint16(neighbor->delivered, links[i].delivered);
+    put_uint16(neighbor->retransmissions, links[i].retransmissions);
+    put_uint16(neighbor->lost, links[i].lost);
+    neighbor->etx = links[i].etx;
+    neighbor->rssi = (uint8_t)(int8_t)(links[i].rssi / 8);
+    stats_record.num_neighbors++;
+  }
+
+  length = sizeof(stats_record) - (STATS_MAX_NEIGHBORS - stats_record.num_neighbors) * sizeof(struct stats_neighbor_wire);
+  log_printf("STATS ");
+  for (i = 0; i < length; i++) {
+    log_printf("%02x", ((uint8_t *)&stats_record)[i]);
+  }
+  log_printf("\n");
+}
+
+/**
+ * @brief Unicast forward process handles forwarding the packets that are stored in the queue in a way that avoids collisons.
+ *
+ * The process sleeps until recv_unicast posts packet_queued_event and then drains the queues, urgent queue first, until
+ * no packet is ready. Every frame waits for a random backoff within the contention window, timed by an rtimer, and is
+ * only sent if the radio is neither receiving nor holding a received packet afterwards. Otherwise the window grows and
+ * a new backoff starts. Queued packets to the same next hop are bundled into one frame, normal packets are held back for up to
+ * AGGREGATION_MAX_HOLD to give other packets a chance to join.
+ *
+ * One frame is handed to the MAC layer at a time and with a single transmission attempt, so that retransmissions are
+ * scheduled here: sent_unicast() polls the process once the frame was acknowledged or lost, and packets of a lost frame
+ * back off in their queue while the packets behind them go ahead. A timer wakes the process up when the next backoff
+ * ends.
+ */
+PROCESS_THREAD(unicast_forward_process, ev, data) {
+  static struct etimer retry_timer;
+  static struct unicast_packet *next;
+  static clock_time_t wait;
+
+  PROCESS_BEGIN();
+
+  packet_queued_event = process_alloc_event();
+  memb_init(&packet_pool);
+  for (int p = 0; p < NUM_PRIORITIES; p++) {
+    LIST_STRUCT_INIT(&unicast_queues[p], packets);
+  }
+  unicast_open(&unicast, 146, &unicast_callbacks);
+
+  while (1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == packet_queued_event || ev == PROCESS_EVENT_POLL ||
+                             (ev == PROCESS_EVENT_TIMER && etimer_expired(&retry_timer)));
+
+    // Never wait forever for the MAC layer to report on a frame
+    if (frame_in_flight && ev == PROCESS_EVENT_TIMER) {
+      LOG_WARN("No transmission status for the last frame, counting it as lost\n");
+      forward_complete(0);
+    }
+
+    // Keep forwarding until no packet is ready to be sent
+    while (!frame_in_flight && (next = queue_next(&wait)) != NULL) {
+      // Give more packets the chance to join the bundle
+      wait = bundle_hold_time(next);
+      if (wait > 0) {
+        break;
+      }
+
+      // Wait for a random backoff before every frame, the backoff timer polls the process when it ends
+      if (backoff_state != BACKOFF_DONE) {
+        if (backoff_state == BACKOFF_IDLE) {
+          backoff_start();
         }
-        queue_size--;
+        break;
+      }
+      backoff_state = BACKOFF_IDLE;
 
-        printf("Forwarded unicast packet removed from the queue.\n");
+      // Check if the node is currently receiving or sending a packet
+      if (NETSTACK_RADIO.receiving_packet() || NETSTACK_RADIO.pending_packet()) {
+        // If the channel is busy, back off again with a larger window
+        LOG_DBG("Node busy, cannot forward unicast packet at the moment!\n");
+        stats[STATS_RADIO_BUSY]++;
+        contention_window_update(1);
+        backoff_start();
+        break;
       }
+
+      // Bundle the packets going to the next hop of the highest priority packet
+      linkaddr_t destination = next->destination;
+      uint16_t length = build_bundle(&destination);
+
+      // Copy the bundle to the packet buffer, retransmissions are scheduled by this process instead of the MAC layer
+      packetbuf_copyfrom(bundle, length);
+      packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS, 1);
+
+      // Send the packet using unicast, the MAC layer may report back before unicast_send() returns
+      LOG_DBG("Forwarding %u bytes to: %d.%d\n", length, destination.u8[0], destination.u8[1]);
+      // The deadline is set once per frame, events that arrive while it is in flight do not push it out
+      linkaddr_copy(&frame_destination, &destination);
+      frame_in_flight = 1;
+      etimer_set(&retry_timer, FORWARD_SENT_TIMEOUT);
+      wait = 0;
+      unicast_send(&unicast, &destination);
+      stats[STATS_TX_DATA_FRAMES]++;
+
+      // Let the radio transmit the frame before handing over the next one
+      PROCESS_PAUSE();
     }
 
-    etimer_reset(&et);
+    // Wake up when the hold time or a retransmission backoff ends, the frame in flight keeps its deadline
+    if (wait > 0 && !frame_in_flight) {
+      etimer_set(&retry_timer, wait);
+    }
   }
 
   PROCESS_END();